@@ -2,16 +2,34 @@
 #include "application.hpp"
 #include "app_config.hpp"
 #include "g_calendar_config.hpp"
+#include "g_calendar_store.hpp"
+#include "tls_resume_transport.hpp"
+#include "response_arena.hpp"
+#include "retry_scheduler.hpp"
+#include "event_cache.hpp"
+#include "event_merge.hpp"
+#include "event_time.hpp"
+#include "string_pool.hpp"
+#include "wake_arena.hpp"
 #include <algorithm>
 #include <set>
+#include <ctime>
+#include <cstdlib>
 #include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <freertos/queue.h>
 
 #define WIFI_CONNECTED_BIT BIT0
 #define LOCALTIME_SET_BIT BIT1
 
 #define ACCESS_TOKEN_KEY "access_token"
+#define TOKEN_TIME_KEY   "token_acquired" // Epoch seconds the access token was issued at
+#define TOKEN_TTL_KEY    "token_ttl"      // Its expires_in
 #define FIRST_RUN_KEY    "first_run"
 #define RETRY_KEY        "retry_count"
+#define DRAWN_DATE_KEY   "drawn_date"
+#define TEMP_RETRY_KEY   "temp_retries"   // "<date>:<count>" of redraws for the panel temperature
 
 static const char* TAG = "[App]";
 
@@ -39,6 +57,14 @@ void Application::run() {
         ESP_ERROR_CHECK(nvs_flash_init());
     }
     ESP_LOGI(TAG, "NVS Initialized successfully.");
+    WakeArena::logHeap("at wake");
+
+#if EVENT_MERGE_BENCHMARK
+    EventMerge::benchmark();
+#endif
+
+    // Stored events and sync tokens live in their own partition
+    CalendarEventStore::init();
 
     bool isFirstRun = true;
     std::string nvsState = getDataFromNVS(FIRST_RUN_KEY);
@@ -56,6 +82,10 @@ void Application::run() {
     int bar_x = epaper_x_center - 200;
     int bar_y = epaper_y_center + 100;
 
+    // The RTC kept the clock through sleep or reset, SNTP only corrects it later
+    localTime.restoreClock();
+    bool paintedFromCache = false;
+
    if (isFirstRun) {
         // Show splash screen and progress bar
         epaper.splash();
@@ -63,136 +93,217 @@ void Application::run() {
         epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Center, epaper_x_center, epaper_y_center + 60, "System Loading");
         epaper.drawProgressBar(bar_x, bar_y, 30);
         epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 150, "[OK] E-Paper Display");
+        epaper.commit();
 
         wifi.init();
         wifi.start();
-
         ESP_LOGI(TAG, "Waiting for WiFi connection...");
-        xEventGroupWaitBits(event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-        ESP_LOGI(TAG, "WiFi Connected!");
-
-        epaper.drawProgressBar(bar_x, bar_y, 60);
-        epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 180, "[OK] WIFI Connected");
     } else {
+        // After a reset the panel may show anything, put the cached calendar up before the network is
+        if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER) {
+            paintedFromCache = drawFromCache();
+        }
+
         // Skip splash and directly initialize Wi-Fi
         wifi.init();
         wifi.start();
-        xEventGroupWaitBits(event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
     }
 
-    std::string currentDateTime = localTime.obtainTime();
-    xEventGroupWaitBits(event_group, LOCALTIME_SET_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    // A missing AP is handled like any other failed fetch instead of blocking forever
+    bool online = xEventGroupWaitBits(event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                      pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS)) & WIFI_CONNECTED_BIT;
+    if (online && isFirstRun) {
+        ESP_LOGI(TAG, "WiFi Connected!");
+        epaper.drawProgressBar(bar_x, bar_y, 60);
+        epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 180, "[OK] WIFI Connected");
+        epaper.commit();
+    }
+
+    std::string currentDateTime;
+    if (online) {
+        currentDateTime = localTime.obtainTime();
+        online = xEventGroupWaitBits(event_group, LOCALTIME_SET_BIT, pdFALSE, pdTRUE,
+                                     pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS)) & LOCALTIME_SET_BIT;
+    } else {
+        ESP_LOGE(TAG, "No WiFi connection after %d ms", WIFI_CONNECT_TIMEOUT_MS);
+    }
     
-    if (isFirstRun) {
+    if (online && isFirstRun) {
         epaper.drawProgressBar(bar_x, bar_y, 80);
         epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 210, currentDateTime.c_str());
+        epaper.commit();
     }
 
     //Need to complete Screen drawing first
-    std::vector<CalendarEvent> events;
-    if(fetchCalendarEvents(events) == ESP_OK){
+    EventList events;
+    bool unchanged = false;
+    esp_err_t fetchResult = online ? fetchCalendarEvents(events, unchanged) : ESP_ERR_TIMEOUT;
+    const std::string today = localTime.getTodayDate();
+
+    // Only complete results are cached, so the cache always matches a full draw
+    bool cacheChanged = true;
+    if (fetchResult == ESP_OK) {
+        EventCache::save(events, today.substr(0, 7), cacheChanged);
+    }
+
+    // Nothing new since the panel was last drawn, it still shows the right picture
+    if (fetchResult == ESP_OK && (unchanged || !cacheChanged) && !isFirstRun && getDataFromNVS(DRAWN_DATE_KEY) == today) {
+        ESP_LOGI(TAG, "All calendars not modified, skipping redraw");
+        storeDataInNVS(RETRY_KEY, "0");
+        hibernate(localTime.scheduleHibernationUntilMidnight30());
+    }
+
+    bool temperatureRetry = false;
+
+    // ESP_ERR_NOT_FINISHED: some calendars only have their stored copy, still worth drawing
+    if(fetchResult == ESP_OK || fetchResult == ESP_ERR_NOT_FINISHED){
         if (isFirstRun) {
             epaper.drawProgressBar(bar_x, bar_y, 100);
             epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 240, "[OK] Fectching Calendar Events");
+            epaper.commit();
 
             // Mark the state in NVS
             storeDataInNVS(FIRST_RUN_KEY, "updated");
         }
 
-        // Reset retry counter on success   
-        storeDataInNVS(RETRY_KEY, "0");
+        // Reset retry counter on success, stale calendars keep counting
+        retryCount = fetchResult == ESP_OK ? 0 : retryCount + 1;
+        storeDataInNVS(RETRY_KEY, std::to_string(retryCount));
 
-        std::reverse( events.begin(), events.end() );
+        drawCalendar(events, "Updated: " + currentDateTime);
 
-        auto [startDate, endDate] = localTime.getStartAndEndDates();
-        ESP_LOGI(TAG, "Start Date: %s", startDate.c_str());
-        ESP_LOGI(TAG, "End Date: %s", endDate.c_str());
+        // The reading the frame was drawn with, still cached
+        int celsius = epaper.ambientTemperature();
+        temperatureRetry = (celsius < PANEL_MIN_TEMP_C || celsius > PANEL_MAX_TEMP_C) && takeTemperatureRetry(today);
 
-        // Need to make another function   
-        int offset_pos = localTime.getFirstDayOfMonth();
-        int max_date = localTime.getLastDayOfMonth();
-        ESP_LOGI(TAG, "offset_pos: %d, max_date: %d", offset_pos, max_date);
+        // A partial draw differs from the cache, so the next complete fetch must not be skipped.
+        // Neither must one drawn too cold or too hot, until today's redraws are used up.
+        storeDataInNVS(DRAWN_DATE_KEY, fetchResult == ESP_OK && !temperatureRetry ? today : "");
 
-        epaper.drawCalendarBase(offset_pos, max_date, localTime.getCurrentMonthYear().c_str(), localTime.getTodayDay());
+    }else{
+        // Only the boot screen is replaced, otherwise the panel keeps the last good calendar
+        if (isFirstRun) {
+            epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 240, "[Fail] Fectching Calendar Events");
+            epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 270, "Check the AccessToken and RefreshToken");
+            epaper.commit();
+        } else if (!paintedFromCache && getDataFromNVS(DRAWN_DATE_KEY) != today) {
+            // A new day since the last draw, at least move the grid on using the cached events
+            drawFromCache();
+        }
 
-        printEventsInRange(events, startDate, endDate);
+        // Sleep on a backoff schedule rather than rebooting straight into the same outage
+        storeDataInNVS(RETRY_KEY, std::to_string(++retryCount));
+        hibernate(RetryScheduler::sleepAfterFailures(retryCount, localTime.scheduleHibernationUntilMidnight30()));
+    }
 
-        int epaper_y2 = epaper.getHeight() - (epaper.getHeight() / 3);
-        epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Center, epaper_x_center, epaper_y2, "Upcoming Events");
-        epaper.drawBar(20, epaper_y2 + 10, epaper.getWidth() - 40, 2);
-        epaper.drawBar(epaper.getWidth()/2 - 1, epaper_y2 + 10, 2, epaper.getHeight() / 3 - 30);
-        epaper.invalidate();
+    uint32_t sleepSeconds = localTime.scheduleHibernationUntilMidnight30();
+    if (retryCount > 0) {
+        // Come back early for the calendars that could not be refreshed
+        sleepSeconds = RetryScheduler::sleepAfterFailures(retryCount, sleepSeconds);
+    }
+    if (temperatureRetry) {
+        sleepSeconds = RetryScheduler::sleepForTemperature(epaper.ambientTemperature(), sleepSeconds);
+    }
+    hibernate(sleepSeconds);
+}
 
-        // Sort events by their start date
-        sortEventsByStartDate(events);
-        printEventSummary(events, localTime.getTodayDate().c_str());
+// Ends the refresh cycle: everything it built goes back in one reset, then deep sleep
+void Application::hibernate(uint32_t seconds) {
+    // The panel keeps its picture through sleep, the next wake diffs against this copy
+    epaper.saveFrame();
+    epaper.logPowerStats();
 
-    }else{
-        epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 240, "[Fail] Fectching Calendar Events");
-        epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Left, epaper_x_center - 200, epaper_y_center + 270, "Check the AccessToken and RefreshToken");
+    WakeArena::shared().logStats();
+    WakeArena::logHeap("before reset");
+    StringPool::shared().reset();
+    WakeArena::shared().reset();
+    WakeArena::logHeap("after reset");
 
-        storeDataInNVS(FIRST_RUN_KEY, "");
-        storeDataInNVS(RETRY_KEY, std::to_string(++retryCount)); // Increment retry counter and reboot
+    esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
+    esp_deep_sleep_start();
+}
 
-        if(retryCount >= 2){
-            esp_deep_sleep_start();
-        }else{
-            esp_restart();
-        }
-        
-    }
+// Draws the month grid, the upcoming events and a footer line
+template <typename Events>
+void Application::drawCalendar(const Events& events, const std::string& footer) {
+    int epaper_x_center = epaper.getWidth() / 2;
 
-    epaper.drawText(epaper.font_tiny, EPaper::TEXT_ALIGN::Right, epaper.getWidth() - 20 , epaper.getHeight() - 8, ("Updated: " + currentDateTime).c_str());
+    int offset_pos = localTime.getFirstDayOfMonth();
+    int max_date = localTime.getLastDayOfMonth();
+    ESP_LOGI(TAG, "offset_pos: %d, max_date: %d", offset_pos, max_date);
 
-    esp_sleep_enable_timer_wakeup(localTime.scheduleHibernationUntilMidnight30() * 1000000ULL);
-    esp_deep_sleep_start(); 
-}
+    // Civil day numbers of today and of the month shown, events carry the same
+    struct tm now = {};
+    localTime.getCurrentTimeInfo(now);
+    const int32_t today = EventTime::dayNumber(now.tm_year + 1900, now.tm_mon + 1, now.tm_mday);
+    const int32_t firstDay = today - now.tm_mday + 1;
 
-// Function to increment date by one day
-std::string Application::incrementDate(const std::string& date) {
-    // Parse the input date (YYYY-MM-DD) using sscanf
-    struct tm timeStruct = {};
-    if (sscanf(date.c_str(), "%4d-%2d-%2d", &timeStruct.tm_year, &timeStruct.tm_mon, &timeStruct.tm_mday) != 3) {
-         ESP_LOGE("Main", "Failed to parse date: %s", date.c_str());
-    }
+    epaper.drawCalendarBase(offset_pos, max_date, localTime.getCurrentMonthYear().c_str(), localTime.getTodayDay());
 
-    // Adjust the tm_year and tm_mon since sscanf uses 0-based months and years
-    timeStruct.tm_year -= 1900;  // Years since 1900
-    timeStruct.tm_mon -= 1;      // Months are 0-11, so subtract 1
+    // Bucketed once, each day cell then only visits its own events
+    DayIndex index(events, firstDay, max_date);
+    printEventsInRange(events, index);
 
-    // Add one day (86400 seconds) to the time
-    timeStruct.tm_mday += 1;
+    int epaper_y2 = epaper.getHeight() - (epaper.getHeight() / 3);
+    epaper.drawText(epaper.font_mid, EPaper::TEXT_ALIGN::Center, epaper_x_center, epaper_y2, "Upcoming Events");
+    epaper.drawBar(20, epaper_y2 + 10, epaper.getWidth() - 40, 2);
+    epaper.drawBar(epaper.getWidth()/2 - 1, epaper_y2 + 10, 2, epaper.getHeight() / 3 - 30);
 
-    // Normalize the time structure
-    if (mktime(&timeStruct) == -1) {
-         ESP_LOGE("Main", "Failed to increment date: %s", date.c_str());
-    }
+    // Events arrive merged in start time order
+    printEventSummary(events, today);
 
-    // Convert the updated tm structure back to a string (YYYY-MM-DD) using strftime
-    char newDate[11];  // Buffer for the new date string in the format YYYY-MM-DD
-    if (strftime(newDate, sizeof(newDate), "%Y-%m-%d", &timeStruct) == 0) {
-        ESP_LOGE("Main", "Failed to format incremented date.");
-    }
+    epaper.drawText(epaper.font_tiny, EPaper::TEXT_ALIGN::Right, epaper.getWidth() - 20 , epaper.getHeight() - 8, footer.c_str());
 
-    return std::string(newDate);
+    // The whole calendar goes to the panel in one update
+    epaper.commit();
 }
 
-bool Application::isDateWithinRange(const std::string& date, const CalendarEvent& event) {
-      if (event.isAllDayEvent) {
-            // For all-day events, exclude the end date
-            return date >= event.start.substr(0, 10) && date < event.end.substr(0, 10);
-      } else {
-            // For non-all-day events, include the end date
-            return date >= event.start.substr(0, 10) && date <= event.end.substr(0, 10);
-      }
+// Counts a redraw for the panel temperature, false once TEMPERATURE_RETRIES_PER_DAY
+// are used up today. A panel that stays out of range then keeps the normal schedule.
+bool Application::takeTemperatureRetry(const std::string& today) {
+    const std::string prefix = today + ":";
+    std::string stored = getDataFromNVS(TEMP_RETRY_KEY);
+    int used = stored.compare(0, prefix.size(), prefix) == 0 ? atoi(stored.c_str() + prefix.size()) : 0;
+    if (used >= TEMPERATURE_RETRIES_PER_DAY) {
+        ESP_LOGW(TAG, "Panel still out of range after %d redraws today, keeping this frame", used);
+        return false;
+    }
+    storeDataInNVS(TEMP_RETRY_KEY, prefix + std::to_string(used + 1));
+    return true;
+}
+
+// Draws the events of the last complete fetch from flash, false if none are cached for this month
+bool Application::drawFromCache() {
+    EventCache cache;
+    if (!cache.open()) {
+        return false;
+    }
+    const std::string today = localTime.getTodayDate();
+    if (cache.getMonth() != today.substr(0, 7)) {
+        ESP_LOGI(TAG, "Cached events are for %s, not drawing them", cache.getMonth().c_str());
+        return false;
+    }
+
+    struct tm timeinfo = {};
+    time_t savedAt = cache.getSavedAt();
+    localtime_r(&savedAt, &timeinfo);
+    char saved[64];
+    strftime(saved, sizeof(saved), "%c", &timeinfo);
+
+    // Drawn from the records in place, event text points into the mapping,
+    // which stays open until the draw is done
+    ESP_LOGI(TAG, "Drawing %d cached events", (int)cache.size());
+    drawCalendar(cache, std::string("Cached: ") + saved);
+    storeDataInNVS(DRAWN_DATE_KEY, today);
+    return true;
 }
 
-void Application::printEventsInRange(const std::vector<CalendarEvent>& events, const std::string& start, const std::string& end) {
-      std::string currentDate = start;
-      while (currentDate <= end) {
-            // Extract the day number from the current date
-            int day = std::stoi(currentDate.substr(8, 2)); // Extract "DD" and convert to integer
-            ESP_LOGI(TAG, "Event on %s (Day %d):", currentDate.c_str(), day);
+template <typename Events>
+void Application::printEventsInRange(const Events& events, const DayIndex& index) {
+      const int32_t firstDay = index.getFirstDay();
+      for (int32_t currentDay = firstDay; currentDay < firstDay + index.getDayCount(); currentDay++) {
+            int day = currentDay - firstDay + 1; // Day of the month
+            ESP_LOGI(TAG, "Event on day %d:", day);
 
             EPaper::Coordinates coords = epaper.getCoordinatesForDay(day);
             if (coords.x != -1 && coords.y != -1) {
@@ -200,72 +311,59 @@ void Application::printEventsInRange(const std::vector<CalendarEvent>& events, c
             } else {
                 printf("Invalid day: %d\n", day);
             }
-            //ESP_LOGI(TAG, "Event on %s:", currentDate.c_str());
-            bool found = false;
+            DayIndex::Bucket bucket = index.eventsOn(currentDay);
             int slot = 1;
 
-            for (const auto& event : events) {
-                  if (isDateWithinRange(currentDate, event)) {
-                        found = true;
-                        epaper.drawTextInSlot(slot++, coords.x, coords.y, event.organizerDisplayName.substr(0, 4).c_str());
-                        //std::cout << " - " << event.summary << " (Start: " << event.start << ", End: " << event.end << ")\n";
-                        ESP_LOGI(TAG, "Event: %s", event.summary.c_str());
-                        ESP_LOGI(TAG, "Description: %s", event.description.c_str());
-                        ESP_LOGI(TAG, "Start: %s", event.start.c_str());
-                        ESP_LOGI(TAG, "End: %s\n\n", event.end.c_str());
-                  }
+            for (uint32_t i : bucket) {
+                  const CalendarEvent& event = events[i];
+                  char label[5];
+                  snprintf(label, sizeof(label), "%s", event.organizerDisplayName);
+                  epaper.drawTextInSlot(slot++, coords.x, coords.y, label);
+                  ESP_LOGI(TAG, "Event: %s", event.summary);
+                  ESP_LOGI(TAG, "Description: %s", event.description);
+                  ESP_LOGI(TAG, "Start: %lld", (long long)event.start);
+                  ESP_LOGI(TAG, "End: %lld\n\n", (long long)event.end);
             }
             
 
-            if (!found) {
+            if (bucket.empty()) {
                   ESP_LOGI(TAG, "No events\n");
-            }else{
-                epaper.invalidate();
             }
-            currentDate = incrementDate(currentDate);
       }
 }
 
-// Bubble sort for CalendarEvent objects
-void Application::sortEventsByStartDate(std::vector<CalendarEvent>& events) {
-    for (size_t i = 0; i < events.size(); ++i) {
-        for (size_t j = 0; j < events.size() - i - 1; ++j) {
-            if (events[j].start > events[j + 1].start) {
-                // Swap elements if they are out of order
-                CalendarEvent temp = events[j];
-                events[j] = events[j + 1];
-                events[j + 1] = temp;
-            }
-        }
-    }
-}
-
-std::vector<std::string> Application::truncateString(const std::string& str, size_t maxLength = 54, size_t maxLines = 4) {
-    std::vector<std::string> lines;
-    std::string currentLine;
+// Lines are copied into the WakeArena
+Application::LineList Application::truncateString(const char* str, size_t maxLength = 54, size_t maxLines = 4) {
+    WakeArena& arena = WakeArena::shared();
+    LineList lines;
+    size_t lineStart = 0;  // The current line is str[lineStart, lineStart + lineLength)
+    size_t lineLength = 0;
     size_t i = 0;
 
-    while (i < str.size() && lines.size() < maxLines) {
+    while (str[i] != '\0' && lines.size() < maxLines) {
         // Check for line breaks (\n or \r\n)
         if (str[i] == '\n') {
             // Add the current line to the result and start a new line
-            lines.push_back(currentLine);
-            currentLine.clear();
+            lines.push_back(arena.copy(str + lineStart, lineLength));
             i++;
-        } else if (str[i] == '\r' && i + 1 < str.size() && str[i + 1] == '\n') {
+            lineStart = i;
+            lineLength = 0;
+        } else if (str[i] == '\r' && str[i + 1] == '\n') {
             // Handle Windows-style line breaks (\r\n)
-            lines.push_back(currentLine);
-            currentLine.clear();
+            lines.push_back(arena.copy(str + lineStart, lineLength));
             i += 2;
+            lineStart = i;
+            lineLength = 0;
         } else {
             // Add the character to the current line
-            currentLine += str[i];
+            lineLength++;
             i++;
 
             // If the current line exceeds maxLength, split it
-            if (currentLine.size() >= maxLength) {
-                lines.push_back(currentLine);
-                currentLine.clear();
+            if (lineLength >= maxLength) {
+                lines.push_back(arena.copy(str + lineStart, lineLength));
+                lineStart = i;
+                lineLength = 0;
 
                 // Stop if we've reached the max number of lines
                 if (lines.size() >= maxLines) {
@@ -276,35 +374,39 @@ std::vector<std::string> Application::truncateString(const std::string& str, siz
     }
 
     // Add any remaining content in the current line (if under maxLines)
-    if (!currentLine.empty() && lines.size() < maxLines) {
-        lines.push_back(currentLine);
+    if (lineLength > 0 && lines.size() < maxLines) {
+        lines.push_back(arena.copy(str + lineStart, lineLength));
     }
 
     return lines;
 }
 
 
-void Application::printEventSummary(const std::vector<CalendarEvent>& events, const std::string& startDate) {
-    std::set<std::string> printedEvents; // Set to track processed events
+template <typename Events>
+void Application::printEventSummary(const Events& events, int32_t startDay) {
+    // Set to track processed events
+    std::set<std::pair<time_t, time_t>, std::less<std::pair<time_t, time_t>>,
+             ArenaAllocator<std::pair<time_t, time_t>>> printedEvents;
     const int maxEventsToDisplay = 6;    // Limit to 6 events
     int eventCount = 0;                  // Counter to track the number of events printed
     int epaper_x2 = 20;
     int epaper_y2 = epaper.getHeight() - (epaper.getHeight() / 3) + 40;
 
-    ESP_LOGI(TAG, "Event Summary (After %s):", startDate.c_str());
-    for (const auto& event : events) {
+    ESP_LOGI(TAG, "Event Summary (After day %d):", (int)startDay);
+    for (size_t i = 0; i < events.size(); i++) {
         // Stop processing if we've reached the max number of events
         if (eventCount >= maxEventsToDisplay) {
             break;
         }
+        const CalendarEvent& event = events[i];
 
-        // Check if the event starts on or after the given startDate
-        if (event.start < startDate) {
+        // Check if the event starts on or after the given day
+        if (event.startDay < startDay) {
             continue; // Skip events that start before the given date
         }
 
-        // Use a unique identifier for the event (e.g., start + end date)
-        std::string uniqueID = event.start + "-" + event.end;
+        // Use a unique identifier for the event (e.g., start + end time)
+        std::pair<time_t, time_t> uniqueID(event.start, event.end);
 
         // Skip if this event has already been processed
         if (printedEvents.find(uniqueID) != printedEvents.end()) {
@@ -315,26 +417,28 @@ void Application::printEventSummary(const std::vector<CalendarEvent>& events, co
         printedEvents.insert(uniqueID);
         
         // Print the event summary
-        ESP_LOGI(TAG, "organizerDisplayName: %s", event.organizerDisplayName.c_str());
-        ESP_LOGI(TAG, "Event: %s", event.summary.c_str());
-        ESP_LOGI(TAG, "Description: %s", event.description.c_str());
-        ESP_LOGI(TAG, "Start: %s", event.start.c_str());
-        ESP_LOGI(TAG, "End: %s\n", event.end.c_str());
+        ESP_LOGI(TAG, "organizerDisplayName: %s", event.organizerDisplayName);
+        ESP_LOGI(TAG, "Event: %s", event.summary);
+        ESP_LOGI(TAG, "Description: %s", event.description);
+        ESP_LOGI(TAG, "Start: %lld", (long long)event.start);
+        ESP_LOGI(TAG, "End: %lld\n", (long long)event.end);
         ESP_LOGI(TAG, "isAllEvent: %d\n", event.isAllDayEvent);
 
-        epaper.drawText(epaper.font_sml, EPaper::TEXT_ALIGN::Left, epaper_x2, epaper_y2, (event.organizerDisplayName + " - " +event.summary).c_str());
+        char title[256];
+        snprintf(title, sizeof(title), "%s - %s", event.organizerDisplayName, event.summary);
+        epaper.drawText(epaper.font_sml, EPaper::TEXT_ALIGN::Left, epaper_x2, epaper_y2, title);
         epaper_y2 += 20;
         epaper.drawText(epaper.font_tiny, EPaper::TEXT_ALIGN::Left, epaper_x2, epaper_y2, (localTime.formatRangeToCustomDate(event.start, event.end, event.isAllDayEvent)).c_str());
         epaper_y2 += 18;
 
-        if(!event.description.empty()){
+        if(event.description[0] != '\0'){
 
             // Get the truncated description lines
-            std::vector<std::string> descriptionLines = truncateString(event.description);
+            LineList descriptionLines = truncateString(event.description);
               // Print each line of the description
-            for (const auto& line : descriptionLines) {
-                ESP_LOGI(TAG, "Description: %s", line.c_str());
-                epaper.drawText(epaper.font_tiny, EPaper::TEXT_ALIGN::Left, epaper_x2, epaper_y2, line.c_str());
+            for (const char* line : descriptionLines) {
+                ESP_LOGI(TAG, "Description: %s", line);
+                epaper.drawText(epaper.font_tiny, EPaper::TEXT_ALIGN::Left, epaper_x2, epaper_y2, line);
                 epaper_y2 += 16;
             }
         }
@@ -352,8 +456,6 @@ void Application::printEventSummary(const std::vector<CalendarEvent>& events, co
           // Increment the event counter
         ++eventCount;
     }
-
-    epaper.invalidate();
 }
 
 void Application::storeDataInNVS(const std::string& key, const std::string& data) {
@@ -395,16 +497,111 @@ std::string Application::getDataFromNVS(const std::string& key) {
     return "";
 }
 
-esp_err_t Application::fetchCalendarEvents(std::vector<CalendarEvent>& events) {
-    esp_err_t ret = ESP_OK;
+// Shared by the fetch workers of one runFetchPool() call
+struct FetchPoolContext {
+    std::vector<CalendarFetchJob>* jobs;
+    const std::string* accessToken;
+    QueueHandle_t queue;      // Indices into jobs still to be fetched
+    EventGroupHandle_t done;  // One bit per worker
+};
+
+struct FetchWorkerParam {
+    FetchPoolContext* pool;
+    EventBits_t doneBit;
+};
+
+// Fetches queued calendars until the queue is empty, all on gCalendar's connection
+static void drainFetchQueue(FetchPoolContext* pool, GoogleCalendar& gCalendar) {
+    int index;
+    while (xQueueReceive(pool->queue, &index, 0) == pdTRUE) {
+        CalendarFetchJob& job = (*pool->jobs)[index];
+        ESP_LOGI(TAG, "Fetching events for calendar ID: %s (core %d)", job.calendarId.c_str(), xPortGetCoreID());
+        job.result = gCalendar.syncEvents(*pool->accessToken, job.calendarId, job.events, job.unchanged);
+    }
+}
 
-    GoogleCalendar gCalendar(
-        CalendarConfig::getClientId(),
-        CalendarConfig::getClientSecret(),
-        CalendarConfig::getRefreshToken()
-    );
+static void fetch_worker_task(void* param) {
+    FetchWorkerParam* worker = static_cast<FetchWorkerParam*>(param);
+    FetchPoolContext* pool = worker->pool;
+
+    {
+        // A helper opens a second connection, only worth it with a calendar to spare
+        GoogleCalendar gCalendar(
+            CalendarConfig::getClientId(),
+            CalendarConfig::getClientSecret(),
+            CalendarConfig::getRefreshToken()
+        );
+        drainFetchQueue(pool, gCalendar);
+    }
+
+    xEventGroupSetBits(pool->done, worker->doneBit);
+    vTaskDelete(NULL);
+}
+
+// The calling task is the first worker and fetches on gCalendar, so the
+// connection the batch request opened is reused. Helper tasks, each with its
+// own connection, are only started for calendars beyond the first.
+void Application::runFetchPool(GoogleCalendar& gCalendar, std::vector<CalendarFetchJob>& jobs,
+                               const std::string& accessToken) {
+    int pending = std::count_if(jobs.begin(), jobs.end(), [](const CalendarFetchJob& job) {
+        return job.result != ESP_OK;
+    });
+    if (pending == 0) {
+        return;
+    }
+
+    FetchPoolContext pool;
+    pool.jobs = &jobs;
+    pool.accessToken = &accessToken;
+    pool.queue = xQueueCreate(pending, sizeof(int));
+    pool.done = xEventGroupCreate();
+
+    for (int i = 0; i < (int)jobs.size(); i++) {
+        if (jobs[i].result != ESP_OK) {
+            xQueueSend(pool.queue, &i, 0);
+        }
+    }
+
+    int workerCount = pending < FETCH_WORKER_COUNT ? pending : FETCH_WORKER_COUNT;
+    FetchWorkerParam workers[FETCH_WORKER_COUNT];
+    EventBits_t allDone = 0;
+
+    // Helpers go to the other core first, they spend most of their time waiting on the network
+    for (int i = 1; i < workerCount; i++) {
+        workers[i].pool = &pool;
+        workers[i].doneBit = BIT0 << i;
+        allDone |= workers[i].doneBit;
+
+        char name[16];
+        snprintf(name, sizeof(name), "fetch_%d", i);
+        if (xTaskCreatePinnedToCore(fetch_worker_task, name, FETCH_WORKER_STACK, &workers[i], 5, NULL,
+                                    (xPortGetCoreID() + i) % portNUM_PROCESSORS) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start %s", name);
+            allDone &= ~workers[i].doneBit;
+        }
+    }
+
+    drainFetchQueue(&pool, gCalendar);
+
+    if (allDone) {
+        xEventGroupWaitBits(pool.done, allDone, pdTRUE, pdTRUE, portMAX_DELAY);
+    }
+
+    vEventGroupDelete(pool.done);
+    vQueueDelete(pool.queue);
+}
+
+esp_err_t Application::fetchCalendarEvents(EventList& events, bool& unchanged) {
+    esp_err_t ret = ESP_OK;
 
     const std::vector<std::string>& calendarIds = _CALENDAR_IDS;
+
+    std::vector<CalendarFetchJob> jobs(calendarIds.size());
+    for (size_t i = 0; i < calendarIds.size(); i++) {
+        jobs[i].calendarId = calendarIds[i];
+        jobs[i].result = ESP_FAIL;
+        jobs[i].unchanged = false;
+    }
     
     // Attempt to fetch events with the existing access token
     std::string currentAccessToken = getDataFromNVS(ACCESS_TOKEN_KEY);
@@ -412,43 +609,136 @@ esp_err_t Application::fetchCalendarEvents(std::vector<CalendarEvent>& events) {
         currentAccessToken = CalendarConfig::getAccessToken();
     }
 
-    ESP_LOGI(TAG, "currentAccessToken: %s", currentAccessToken.c_str());
+    int64_t fetchStart = esp_timer_get_time();
+
+    // Tokens live about an hour, so after a night of deep sleep this is the usual case
+    bool refreshed = false;
+    if (isAccessTokenStale()) {
+        ESP_LOGI(TAG, "Access token expired, refreshing before fetching");
+        std::string newAccessToken = refreshAccessToken();
+        if (!newAccessToken.empty()) {
+            currentAccessToken = newAccessToken;
+            refreshed = true;
+        }
+    }
+
+    // Kept for the whole fetch, the batch, the pool and every retry share its connection
+    GoogleCalendar gCalendar(
+        CalendarConfig::getClientId(),
+        CalendarConfig::getClientSecret(),
+        CalendarConfig::getRefreshToken()
+    );
 
-    for (const auto& calendarId : calendarIds) {
-        ESP_LOGI(TAG, "Fetching events for calendar ID: %s", calendarId.c_str());
+#if GCAL_BATCH
+    // One round-trip for all calendars, whatever it cannot finish goes through the pool
+    if (jobs.size() > 1) {
+        gCalendar.syncEventsBatch(currentAccessToken, jobs);
+    }
+#endif
 
-        ret = gCalendar.getEvents(currentAccessToken, calendarId, events);
+    runFetchPool(gCalendar, jobs, currentAccessToken);
 
-        if (ret != ESP_OK && events.empty() ) {
+    // Only the calendars that failed are fetched again, each round after a backoff delay
+    RetryScheduler retry(FETCH_RETRY_BASE_MS, FETCH_RETRY_MAX_MS, FETCH_RETRY_ATTEMPTS);
+    while (std::any_of(jobs.begin(), jobs.end(), [](const CalendarFetchJob& job) { return job.result != ESP_OK; })) {
+        // A token refreshed moments ago failing means revocation or the network, not expiry
+        if (!refreshed) {
             ESP_LOGW(TAG, "No events or token might be invalid. Refreshing access token...");
 
-            // Refresh the access token
-            std::string newAccessToken = gCalendar.refreshAccessToken();
+            std::string newAccessToken = refreshAccessToken();
             if (!newAccessToken.empty()) {
-                ESP_LOGI(TAG, "Access token refreshed: %s", newAccessToken.c_str());
-
-                // Store the new access token in NVS
-                storeDataInNVS(ACCESS_TOKEN_KEY, newAccessToken);
-
-                // Retry fetching events with the new token
                 currentAccessToken = newAccessToken;
-                ret = gCalendar.getEvents(currentAccessToken, calendarId, events);
-
-                if (ret == ESP_OK) {
-                    ESP_LOGI(TAG, "Events retrieved successfully for calendar ID: %s", calendarId.c_str());
-                } else {
-                    ret = ESP_ERR_INVALID_RESPONSE;    
-                    ESP_LOGE(TAG, "Failed to retrieve events even after refreshing token for calendar ID: %s", calendarId.c_str());
-                }
-            } else {
-                ret = ESP_ERR_NOT_ALLOWED;
-                ESP_LOGE(TAG, "Failed to refresh access token. Cannot fetch events for calendar ID: %s", calendarId.c_str());
-                break; // Exit loop as token refresh failed
+                refreshed = true;
+                runFetchPool(gCalendar, jobs, currentAccessToken);
+                continue;
             }
+            ESP_LOGE(TAG, "Failed to refresh access token");
+        }
+
+        if (!retry.waitBeforeRetry()) {
+            break;
+        }
+        runFetchPool(gCalendar, jobs, currentAccessToken);
+    }
+
+    // Merge by start time once every worker is done. A calendar that still
+    // fails falls back to its stored copy without holding back the rest.
+    unchanged = true;
+    int fresh = 0;
+    std::vector<EventList*> streams;
+    for (auto& job : jobs) {
+        unchanged &= (job.result == ESP_OK && job.unchanged);
+        streams.push_back(&job.events);
+        if (job.result == ESP_OK) {
+            ESP_LOGI(TAG, "Events retrieved successfully for calendar ID: %s", job.calendarId.c_str());
+            fresh++;
+            continue;
+        }
+        job.events.clear();
+        if (GoogleCalendar::loadStoredEvents(job.calendarId, job.events)) {
+            ESP_LOGW(TAG, "Using stored events for calendar ID: %s (%s)", job.calendarId.c_str(), esp_err_to_name(job.result));
         } else {
-            ESP_LOGI(TAG, "Events retrieved successfully for calendar ID: %s", calendarId.c_str());
+            ESP_LOGE(TAG, "Failed to retrieve events for calendar ID: %s (%s)", job.calendarId.c_str(), esp_err_to_name(job.result));
         }
     }
 
+    EventMerge::mergeByStart(streams, events);
+
+    if (fresh == 0) {
+        ret = ESP_ERR_INVALID_RESPONSE;
+    } else if (fresh < (int)jobs.size()) {
+        ret = ESP_ERR_NOT_FINISHED;
+    }
+
+    ESP_LOGI(TAG, "Fetched %d calendars in %lld ms, %d events of %d bytes each", (int)jobs.size(),
+             (esp_timer_get_time() - fetchStart) / 1000, (int)events.size(), (int)sizeof(CalendarEvent));
+    GoogleCalendar::logStats();
+    StringPool::shared().logStats();
+    WakeArena::shared().logStats();
+    TlsResumeTransport::logStats();
+    ResponseArena::logStats();
+    ESP_LOGI(TAG, "Heap low-water mark: %d internal, %d PSRAM bytes free",
+             (int)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+             (int)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
     return ret; 
-}
\ No newline at end of file
+}
+
+bool Application::isAccessTokenStale() {
+    time_t now = time(nullptr);
+    if (now < 1577836800) {
+        // Clock not set (before 2020), leave it to the fail-then-refresh path
+        return false;
+    }
+
+    std::string acquired = getDataFromNVS(TOKEN_TIME_KEY);
+    std::string ttl = getDataFromNVS(TOKEN_TTL_KEY);
+    if (getDataFromNVS(ACCESS_TOKEN_KEY).empty() || acquired.empty() || ttl.empty()) {
+        return true; // Built-in token or unknown age
+    }
+
+    long long expiresAt = std::atoll(acquired.c_str()) + std::atoll(ttl.c_str());
+    ESP_LOGI(TAG, "Access token valid for %lld more seconds", expiresAt - (long long)now);
+    return (long long)now + TOKEN_REFRESH_MARGIN >= expiresAt;
+}
+
+// Refreshes the access token and stores it with its lifetime, empty on failure
+std::string Application::refreshAccessToken() {
+    GoogleCalendar gCalendar(
+        CalendarConfig::getClientId(),
+        CalendarConfig::getClientSecret(),
+        CalendarConfig::getRefreshToken()
+    );
+
+    int expiresIn = 0;
+    std::string newAccessToken = gCalendar.refreshAccessToken(expiresIn);
+    if (newAccessToken.empty()) {
+        return newAccessToken;
+    }
+    ESP_LOGI(TAG, "Access token refreshed (expires in %d s)", expiresIn);
+
+    // Store the new access token in NVS
+    storeDataInNVS(ACCESS_TOKEN_KEY, newAccessToken);
+    storeDataInNVS(TOKEN_TIME_KEY, std::to_string((long long)time(nullptr)));
+    storeDataInNVS(TOKEN_TTL_KEY, std::to_string(expiresIn));
+    return newAccessToken;
+}
@@ -0,0 +1,42 @@
+#include "day_index.hpp"
+#include <algorithm>
+#include "event_cache.hpp"
+
+template <typename Events>
+DayIndex::DayIndex(const Events& events, int32_t firstDay, int dayCount)
+    : firstDay(firstDay), dayCount(dayCount), offsets(dayCount + 1, 0) {
+    const int32_t lastDay = firstDay + dayCount - 1;
+
+    // Count per day first so every bucket gets its exact slice of entries
+    for (size_t i = 0; i < events.size(); i++) {
+        int32_t from = std::max(events[i].startDay, firstDay);
+        int32_t to = std::min(events[i].lastDay, lastDay);
+        for (int32_t day = from; day <= to; day++) {
+            offsets[day - firstDay + 1]++;
+        }
+    }
+    for (int i = 0; i < dayCount; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    entries.resize(offsets[dayCount]);
+    std::vector<uint32_t, ArenaAllocator<uint32_t>> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < events.size(); i++) {
+        int32_t from = std::max(events[i].startDay, firstDay);
+        int32_t to = std::min(events[i].lastDay, lastDay);
+        for (int32_t day = from; day <= to; day++) {
+            entries[fill[day - firstDay]++] = i;
+        }
+    }
+}
+
+template DayIndex::DayIndex(const EventList& events, int32_t firstDay, int dayCount);
+template DayIndex::DayIndex(const EventCache& events, int32_t firstDay, int dayCount);
+
+DayIndex::Bucket DayIndex::eventsOn(int32_t day) const {
+    if (day < firstDay || day >= firstDay + dayCount) {
+        return Bucket{nullptr, nullptr};
+    }
+    const uint32_t* base = entries.data();
+    return Bucket{base + offsets[day - firstDay], base + offsets[day - firstDay + 1]};
+}
@@ -1,13 +1,27 @@
 #include "epaper.hpp"
+#include <algorithm>
+#include <cstring>
+#include <esp_timer.h>
+#include "app_config.hpp"
+#include "frame_store.hpp"
 
 static const char *TAG = "[E-Paper]";
 
 #define calrendar_rect_width 114
 #define calrendar_rect_height 110
 
+// Cost of one area update in display rows. Every update runs the whole
+// waveform over each row it covers and pays a fixed setup and settle time
+// on top, so two dirty rectangles are merged whenever updating their union
+// costs less than updating both.
+#define UPDATE_COST_FIXED_ROWS 200
+#define TEXT_BOUNDS_MARGIN     2    // Glyphs may overhang their advance box a little
+
 const char* days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
 
-EPaper::EPaper() : temp(0), fb(nullptr) {}
+EPaper::EPaper()
+    : temp(0), tempReadAt(0), tempValid(false), fb(nullptr), frameKnown(false), frameStored(false), frameChanged(false), diffFrame(false),
+      partialRefreshes(0), powerDepth(0), powerOnSince(0), powerOnUs(0), powerCycles(0) {}
 
 EPaper::~EPaper() {
     // Cleanup if needed
@@ -41,15 +55,58 @@ void EPaper::initialize() {
 
     // Get framebuffer
     fb = epd_hl_get_framebuffer(&hl);
+
+    // What the panel kept showing through deep sleep
+    frameKnown = FrameStore::load(hl.front_fb, frameSize(), partialRefreshes);
+    frameStored = frameKnown;
 }
 
-void EPaper::splash(){
-    epd_poweron();
-    epd_clear();
-    temp = epd_ambient_temperature();
-    epd_poweroff();
-    
+size_t EPaper::frameSize() {
+    return epd_width() / 2 * epd_height();
+}
+
+void EPaper::saveFrame() {
+    if (frameChanged) {
+        FrameStore::save(hl.front_fb, frameSize(), partialRefreshes);
+        frameChanged = false;
+    }
+}
+
+// Flashes the panel white and starts an empty frame
+void EPaper::clearPanel() {
+    {
+        PowerSession power(*this);
+        epd_clear();
+    }
+
+    // The panel is white now, so only what gets drawn differs from it
+    epd_hl_set_all_white(&hl);
+    memset(hl.front_fb, white, frameSize());
+    ops.clear();
+    dirtyRects.clear();
+    frameKnown = true;
+    diffFrame = false;
+    partialRefreshes = 0;
+}
+
+// Starts a frame that replaces the whole picture. Unless the panel is due a
+// clean refresh against ghosting, it is diffed against the previous frame.
+void EPaper::beginFrame() {
+    if (!frameKnown || partialRefreshes >= FRAME_CLEAN_REFRESH_EVERY) {
+        clearPanel();
+        return;
+    }
+
     epd_hl_set_all_white(&hl);
+    ops.clear();
+    dirtyRects.clear();
+    diffFrame = true;
+    partialRefreshes++;
+}
+
+void EPaper::splash(){
+    PowerSession power(*this);
+    clearPanel();
 
     EpdRect home_area = {
         .x = epd_rotated_display_width() / 2 - img_home_width / 2, 
@@ -58,10 +115,8 @@ void EPaper::splash(){
         .height = img_home_height,
     };
 
-    epd_draw_rotated_image(home_area, img_home_data, fb);
-    epd_poweron();
-    checkError(epd_hl_update_screen(&hl, MODE_GL16, temp));
-    epd_poweroff();
+    addImage(home_area, img_home_data);
+    commit();
 }
 
 void EPaper::drawBar(int x, int y, int width, int height){
@@ -72,10 +127,10 @@ void EPaper::drawBar(int x, int y, int width, int height){
         .height = height,
     };
 
-    epd_fill_rect(bar, black, fb);
+    addRect(DrawOp::Kind::FillRect, bar, black);
 }
 
-void EPaper::draw_progress_bar(int x, int y, int width, int percent, uint8_t* fb) {
+void EPaper::draw_progress_bar(int x, int y, int width, int percent) {
  
 
     EpdRect border = {
@@ -84,8 +139,8 @@ void EPaper::draw_progress_bar(int x, int y, int width, int percent, uint8_t* fb
         .width = width,
         .height = 20,
     };
-    epd_fill_rect(border, white, fb);
-    epd_draw_rect(border, black, fb);
+    addRect(DrawOp::Kind::FillRect, border, white);
+    addRect(DrawOp::Kind::StrokeRect, border, black);
 
     EpdRect bar = {
         .x = x + 5,
@@ -94,15 +149,11 @@ void EPaper::draw_progress_bar(int x, int y, int width, int percent, uint8_t* fb
         .height = 10,
     };
 
-    epd_fill_rect(bar, black, fb);
-
-    checkError(epd_hl_update_area(&hl, MODE_DU, epd_ambient_temperature(), border));
+    addRect(DrawOp::Kind::FillRect, bar, black);
 }
 
 void EPaper::drawProgressBar(int bar_x, int bar_y, int percent){
-    epd_poweron();
-    draw_progress_bar(bar_x, bar_y, 400, percent, fb);
-    epd_poweroff();
+    draw_progress_bar(bar_x, bar_y, 400, percent);
 }
 
 void EPaper::drawText(const EpdFont* font, TEXT_ALIGN align, int text_x, int text_y, const char* string) {
@@ -119,21 +170,11 @@ void EPaper::drawText(const EpdFont* font, TEXT_ALIGN align, int text_x, int tex
             font_props.flags = EPD_DRAW_ALIGN_RIGHT;
             break;
     }
-    epd_write_string(font, string, &text_x, &text_y, fb, &font_props);
-
-    // Update screen
-    epd_poweron();
-    checkError(epd_hl_update_screen(&hl, MODE_GL16, temp));
-    epd_poweroff();
+    addText(font, font_props, text_x, text_y, string);
 }
 
 void EPaper::drawCalendarBase(int offset_pos, int max_date, const char* title, int t_day){
-    epd_poweron();
-    epd_clear();
-    temp = epd_ambient_temperature();
-    epd_poweroff();
-
-    epd_hl_set_all_white(&hl);
+    beginFrame();
 
     drawText(font_header, TEXT_ALIGN::Left, 22, 60, title);
 
@@ -158,7 +199,7 @@ void EPaper::drawCalendarBase(int offset_pos, int max_date, const char* title, i
             if(x == -1){ // Draw Calendar Headers
                 text_x = 65 + (y * calrendar_rect_width);
                 text_y = 108;
-                epd_write_string(font_mid, days[y], &text_x, &text_y, fb, &font_props);
+                addText(font_mid, font_props, text_x, text_y, days[y]);
 
             }else{
                 if (offset_pos > 0) {  // Adjust starting position based on the first day of the week
@@ -195,32 +236,25 @@ void EPaper::drawCalendarBase(int offset_pos, int max_date, const char* title, i
 
           
 
-                epd_poweron();
-                epd_draw_rect(border, black, fb);   // Draw the border of the rectangle
+                addRect(DrawOp::Kind::StrokeRect, border, black);   // Draw the border of the rectangle
                 
                  if(current_day == t_day){
-                    epd_fill_rect(sub_border, black, fb); 
+                    addRect(DrawOp::Kind::FillRect, sub_border, black); 
                  }else{
-                    epd_draw_rect(sub_border, black, fb);   // Draw the border of the rectangle
+                    addRect(DrawOp::Kind::StrokeRect, sub_border, black);   // Draw the border of the rectangle
                  }
 
-                char sdate[2];
-                sprintf(sdate, "%d", current_day);
+                char sdate[4];
+                snprintf(sdate, sizeof(sdate), "%d", current_day);
                 int date_x = cursor_x + 108;
                 int date_y = cursor_y + 26;
 
                 if(current_day == t_day){
-                                    epd_write_string(font_mid, sdate, &date_x, &date_y, fb, &font_props_3);
+                                    addText(font_mid, font_props_3, date_x, date_y, sdate);
                  }else{
-                                    epd_write_string(font_mid, sdate, &date_x, &date_y, fb, &font_props_2);
+                                    addText(font_mid, font_props_2, date_x, date_y, sdate);
                  }
 
-
-                    
-
-                checkError(epd_hl_update_area(&hl, MODE_DU, temp, border));
-                epd_poweroff();
-
                 current_day++;  // Move to the next day
             }
           
@@ -235,7 +269,7 @@ void EPaper::drawTextInSlot(int slot, int cursor_x, int cursor_y, const char *te
     
     int text_x = cursor_x + 4;
     int text_y = cursor_y + (24 * slot);
-    epd_write_string(font_mid, text, &text_x, &text_y, fb, &font_props);
+    addText(font_mid, font_props, text_x, text_y, text);
 }
 
 EPaper::Coordinates EPaper::getCoordinatesForDay(int day) {
@@ -254,9 +288,283 @@ int EPaper::getHeight(){
     return epd_rotated_display_height();
 }
 
-void EPaper::invalidate(){
-    // Update screen
-    epd_poweron();
-    checkError(epd_hl_update_screen(&hl, MODE_GL16, temp));
-    epd_poweroff();
-}
\ No newline at end of file
+void EPaper::addText(const EpdFont* font, const EpdFontProperties& props, int x, int y, const char* text) {
+    DrawOp op = {};
+    op.kind = DrawOp::Kind::Text;
+    op.rect.x = x;
+    op.rect.y = y;
+    op.font = font;
+    op.props = props;
+    op.text = WakeArena::shared().copy(text, strlen(text));
+    ops.push_back(op);
+}
+
+void EPaper::addRect(DrawOp::Kind kind, EpdRect rect, uint8_t color) {
+    DrawOp op = {};
+    op.kind = kind;
+    op.color = color;
+    op.rect = rect;
+    ops.push_back(op);
+}
+
+void EPaper::addImage(EpdRect rect, const uint8_t* image) {
+    DrawOp op = {};
+    op.kind = DrawOp::Kind::Image;
+    op.rect = rect;
+    op.image = image;
+    ops.push_back(op);
+}
+
+// Screen area an op touches, clipped to the display
+EpdRect EPaper::bounds(const DrawOp& op) {
+    EpdRect r = op.rect;
+    if (op.kind == DrawOp::Kind::Text) {
+        int x = op.rect.x, y = op.rect.y;
+        int x1 = 0, y1 = 0, w = 0, h = 0;
+        epd_get_text_bounds(op.font, op.text, &x, &y, &x1, &y1, &w, &h, &op.props);
+        if (op.props.flags & EPD_DRAW_ALIGN_CENTER) {
+            x1 -= w / 2;
+        } else if (op.props.flags & EPD_DRAW_ALIGN_RIGHT) {
+            x1 -= w;
+        }
+        r = {x1 - TEXT_BOUNDS_MARGIN, y1 - TEXT_BOUNDS_MARGIN, w + 2 * TEXT_BOUNDS_MARGIN, h + 2 * TEXT_BOUNDS_MARGIN};
+
+        // Later lines of a multi-line string start further down, cover them row-wide
+        for (const char* c = op.text; *c; c++) {
+            if (*c == '\n') {
+                r.x = 0;
+                r.width = getWidth();
+                r.height += op.font->advance_y;
+            }
+        }
+    }
+
+    int x2 = std::min(r.x + r.width, getWidth());
+    int y2 = std::min(r.y + r.height, getHeight());
+    r.x = std::max(r.x, 0);
+    r.y = std::max(r.y, 0);
+    r.width = std::max(x2 - r.x, 0);
+    r.height = std::max(y2 - r.y, 0);
+    return r;
+}
+
+int EPaper::updateCost(const EpdRect& r) {
+    return UPDATE_COST_FIXED_ROWS + r.height + r.width * r.height / getWidth();
+}
+
+// Maps a rectangle of the native framebuffer to rotated coordinates, the
+// inverse of the rotation epdiy applies to every draw
+EpdRect EPaper::rotatedRect(const EpdRect& native) {
+    int x1 = native.x, y1 = native.y;
+    int x2 = native.x + native.width - 1, y2 = native.y + native.height - 1;
+    switch (epd_get_rotation()) {
+        case EPD_ROT_LANDSCAPE:
+            break;
+        case EPD_ROT_PORTRAIT:
+            x1 = native.y; x2 = y2;
+            y1 = epd_width() - 1 - (native.x + native.width - 1); y2 = epd_width() - 1 - native.x;
+            break;
+        case EPD_ROT_INVERTED_LANDSCAPE:
+            x1 = epd_width() - 1 - x2; x2 = epd_width() - 1 - native.x;
+            y1 = epd_height() - 1 - y2; y2 = epd_height() - 1 - native.y;
+            break;
+        case EPD_ROT_INVERTED_PORTRAIT:
+            x1 = epd_height() - 1 - y2; x2 = epd_height() - 1 - native.y;
+            y1 = native.x; y2 = native.x + native.width - 1;
+            break;
+    }
+    return {x1, y1, x2 - x1 + 1, y2 - y1 + 1};
+}
+
+// True if every pixel of the row is pure black or white (two 4-bit pixels per byte)
+static bool isBlackWhite(const uint8_t* row, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        uint8_t high = row[i] >> 4;
+        uint8_t low = row[i] & 0x0F;
+        if ((high != 0x0 && high != 0xF) || (low != 0x0 && low != 0xF)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Compares the new frame with what the panel shows in FRAME_TILE squares of
+// the native framebuffer. Changed tiles of a tile row become one dirty rect
+// per horizontal span. blackWhite tells whether the changed tiles of the new
+// frame hold nothing but black and white pixels.
+int EPaper::diffTiles(bool& blackWhite) {
+    const int width = epd_width();
+    const int height = epd_height();
+    const int stride = width / 2;  // 4 bits per pixel
+    const int columns = (width + FRAME_TILE - 1) / FRAME_TILE;
+    int changedTiles = 0;
+    blackWhite = true;
+
+    for (int ty = 0; ty < height; ty += FRAME_TILE) {
+        int rows = std::min(FRAME_TILE, height - ty);
+        int spanStart = -1;
+        // One column past the edge closes the last span
+        for (int column = 0; column <= columns; column++) {
+            int tx = column * FRAME_TILE;
+            bool changed = false;
+            if (column < columns) {
+                int bytes = std::min(FRAME_TILE, width - tx) / 2;
+                for (int y = ty; y < ty + rows && !changed; y++) {
+                    changed = memcmp(fb + y * stride + tx / 2, hl.front_fb + y * stride + tx / 2, bytes) != 0;
+                }
+            }
+            if (changed) {
+                changedTiles++;
+                int bytes = std::min(FRAME_TILE, width - tx) / 2;
+                for (int y = ty; y < ty + rows && blackWhite; y++) {
+                    blackWhite = isBlackWhite(fb + y * stride + tx / 2, bytes);
+                }
+                if (spanStart < 0) {
+                    spanStart = tx;
+                }
+            } else if (spanStart >= 0) {
+                dirtyRects.push_back(rotatedRect({spanStart, ty, std::min(tx, width) - spanStart, rows}));
+                spanStart = -1;
+            }
+        }
+    }
+    return changedTiles;
+}
+
+// Merges dirty rectangles greedily while the cost model says it pays off
+void EPaper::coalesce() {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < dirtyRects.size(); i++) {
+            for (size_t j = i + 1; j < dirtyRects.size();) {
+                const EpdRect& a = dirtyRects[i];
+                const EpdRect& b = dirtyRects[j];
+                int x1 = std::min(a.x, b.x);
+                int y1 = std::min(a.y, b.y);
+                int x2 = std::max(a.x + a.width, b.x + b.width);
+                int y2 = std::max(a.y + a.height, b.y + b.height);
+                EpdRect u = {x1, y1, x2 - x1, y2 - y1};
+                if (updateCost(u) <= updateCost(a) + updateCost(b)) {
+                    dirtyRects[i] = u;
+                    dirtyRects.erase(dirtyRects.begin() + j);
+                    merged = true;
+                } else {
+                    j++;
+                }
+            }
+        }
+    }
+}
+
+// Plays the display list into the framebuffer in recording order
+void EPaper::render() {
+    for (const DrawOp& op : ops) {
+        switch (op.kind) {
+            case DrawOp::Kind::Text: {
+                int x = op.rect.x;
+                int y = op.rect.y;
+                checkError(epd_write_string(op.font, op.text, &x, &y, fb, &op.props));
+                break;
+            }
+            case DrawOp::Kind::FillRect:
+                epd_fill_rect(op.rect, op.color, fb);
+                break;
+            case DrawOp::Kind::StrokeRect:
+                epd_draw_rect(op.rect, op.color, fb);
+                break;
+            case DrawOp::Kind::Image:
+                epd_draw_rotated_image(op.rect, op.image, fb);
+                break;
+        }
+        EpdRect r = bounds(op);
+        if (r.width > 0 && r.height > 0) {
+            dirtyRects.push_back(r);
+        }
+    }
+    ops.clear();
+}
+
+void EPaper::commit(){
+    int count = ops.size();
+    render();
+
+    // A replaced picture also has to clear what the old one had and this one lacks
+    bool blackWhite = false;
+    if (diffFrame) {
+        dirtyRects.clear();
+        int tiles = diffTiles(blackWhite);
+        ESP_LOGI(TAG, "%d tiles differ from the previous frame (partial refresh %d of %d)", tiles,
+                 (int)partialRefreshes, FRAME_CLEAN_REFRESH_EVERY);
+    }
+    if (dirtyRects.empty()) {
+        diffFrame = false;
+        return;
+    }
+
+    int drawn = dirtyRects.size();
+    coalesce();
+
+    int pixels = 0;
+    for (const EpdRect& r : dirtyRects) {
+        pixels += r.width * r.height;
+    }
+    int percent = (int)(pixels * 100LL / (getWidth() * getHeight()));
+
+    // DU only drives pixels to black or white, so it would flatten the grey
+    // antialiasing of text until the next clean refresh. Small changes to a
+    // known picture get it only when they hold no grey, everything else GL16.
+    EpdDrawMode mode = diffFrame && blackWhite && percent < FRAME_FAST_PERCENT ? MODE_DU : MODE_GL16;
+    diffFrame = false;
+
+    if (frameStored) {
+        FrameStore::invalidate();
+        frameStored = false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    {
+        PowerSession power(*this);
+        int celsius = ambientTemperature();
+        for (const EpdRect& r : dirtyRects) {
+            checkError(epd_hl_update_area(&hl, mode, celsius, r));
+        }
+    }
+    frameChanged = true;
+    ESP_LOGI(TAG, "Committed %d draw ops: %d dirty rects as %d %s updates, %d pixels (%d%% of the screen) in %d ms",
+             count, drawn, (int)dirtyRects.size(), mode == MODE_DU ? "DU" : "GL16", pixels, percent,
+             (int)((esp_timer_get_time() - start) / 1000));
+    dirtyRects.clear();
+}
+
+EPaper::PowerSession::PowerSession(EPaper& epaper) : epaper(epaper) {
+    if (epaper.powerDepth++ == 0) {
+        epd_poweron();
+        epaper.powerOnSince = esp_timer_get_time();
+        epaper.powerCycles++;
+    }
+}
+
+EPaper::PowerSession::~PowerSession() {
+    if (--epaper.powerDepth == 0) {
+        epd_poweroff();
+        epaper.powerOnUs += esp_timer_get_time() - epaper.powerOnSince;
+    }
+}
+
+int EPaper::ambientTemperature() {
+    int64_t now = esp_timer_get_time();
+    if (!tempValid || now - tempReadAt > TEMPERATURE_VALID_MS * 1000LL) {
+        // The sensor sits behind the panel power supply
+        PowerSession power(*this);
+        temp = (int)epd_ambient_temperature();
+        tempReadAt = now;
+        tempValid = true;
+        ESP_LOGI(TAG, "Ambient temperature: %d C", temp);
+    }
+    return temp;
+}
+
+void EPaper::logPowerStats() {
+    ESP_LOGI(TAG, "Panel rails on for %d ms in %d power cycles this wake", (int)(powerOnUs / 1000), powerCycles);
+}
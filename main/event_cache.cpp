@@ -0,0 +1,202 @@
+#include "event_cache.hpp"
+#include <cstring>
+#include <map>
+#include <esp_rom_crc.h>
+#include "esp_log.h"
+
+static const char* TAG = "[Event Cache]";
+
+#define CACHE_MAGIC   0x43454346 // "FCEC"
+#define CACHE_VERSION 2
+
+#define RECORD_ALL_DAY 0x01
+
+EventCache::EventCache() : header(nullptr), records(nullptr), strings(nullptr), mapHandle(0), mapped(false) {}
+
+EventCache::~EventCache() {
+    close();
+}
+
+const esp_partition_t* EventCache::partition() {
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           EVENT_CACHE_PARTITION);
+    if (!part) {
+        ESP_LOGE(TAG, "No '%s' partition", EVENT_CACHE_PARTITION);
+    }
+    return part;
+}
+
+// Appends str to the table once. Event text is interned in the StringPool,
+// so equal strings already share a pointer.
+static uint32_t intern(std::vector<char>& table, std::map<const char*, uint32_t>& offsets, const char* str) {
+    auto it = offsets.find(str);
+    if (it != offsets.end()) {
+        return it->second;
+    }
+    uint32_t offset = table.size();
+    table.insert(table.end(), str, str + strlen(str) + 1);
+    offsets[str] = offset;
+    return offset;
+}
+
+esp_err_t EventCache::save(const EventList& events, const std::string& month, bool& changed) {
+    changed = true;
+    const esp_partition_t* part = partition();
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    std::vector<Record> recs(events.size());
+    std::vector<char> table;
+    std::map<const char*, uint32_t> offsets;
+    for (size_t i = 0; i < events.size(); i++) {
+        const CalendarEvent& event = events[i];
+        Record& rec = recs[i];
+        rec.start = event.start;
+        rec.end = event.end;
+        rec.startDay = event.startDay;
+        rec.lastDay = event.lastDay;
+        rec.summary = intern(table, offsets, event.summary);
+        rec.description = intern(table, offsets, event.description);
+        rec.organizer = intern(table, offsets, event.organizerDisplayName);
+        rec.creator = intern(table, offsets, event.creatorEmail);
+        rec.flags = event.isAllDayEvent ? RECORD_ALL_DAY : 0;
+        rec.reserved = 0;
+    }
+
+    Header head = {};
+    head.magic = CACHE_MAGIC;
+    head.version = CACHE_VERSION;
+    head.recordSize = sizeof(Record);
+    head.count = recs.size();
+    head.stringBytes = table.size();
+    head.crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(recs.data()), recs.size() * sizeof(Record));
+    head.crc = esp_rom_crc32_le(head.crc, reinterpret_cast<const uint8_t*>(table.data()), table.size());
+    head.savedAt = (uint32_t)time(nullptr);
+    strncpy(head.month, month.c_str(), sizeof(head.month) - 1);
+
+    size_t recordBytes = recs.size() * sizeof(Record);
+    size_t total = sizeof(Header) + recordBytes + table.size();
+    if (total > part->size) {
+        ESP_LOGE(TAG, "%d events need %d bytes, partition has %d", (int)recs.size(), (int)total, (int)part->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Same list as last time, spare the flash an erase cycle
+    Header stored;
+    if (esp_partition_read(part, 0, &stored, sizeof(stored)) == ESP_OK && stored.magic == CACHE_MAGIC &&
+        stored.version == CACHE_VERSION && stored.count == head.count && stored.stringBytes == head.stringBytes &&
+        stored.crc == head.crc && strncmp(stored.month, head.month, sizeof(head.month)) == 0) {
+        ESP_LOGI(TAG, "%d events unchanged, not rewritten", (int)recs.size());
+        changed = false;
+        return ESP_OK;
+    }
+
+    size_t eraseSize = (total + part->erase_size - 1) / part->erase_size * part->erase_size;
+    esp_err_t err = esp_partition_erase_range(part, 0, eraseSize);
+
+    // Header goes in last, a write cut short leaves no valid magic behind
+    if (err == ESP_OK) err = esp_partition_write(part, sizeof(Header), recs.data(), recordBytes);
+    if (err == ESP_OK) err = esp_partition_write(part, sizeof(Header) + recordBytes, table.data(), table.size());
+    if (err == ESP_OK) err = esp_partition_write(part, 0, &head, sizeof(head));
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Cached %d events for %s: %d bytes, %d in strings", (int)recs.size(), head.month, (int)total,
+                 (int)table.size());
+    } else {
+        ESP_LOGE(TAG, "Failed to write cache: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool EventCache::open() {
+    close();
+    const esp_partition_t* part = partition();
+    if (!part) {
+        return false;
+    }
+
+    Header head;
+    if (esp_partition_read(part, 0, &head, sizeof(head)) != ESP_OK || head.magic != CACHE_MAGIC ||
+        head.version != CACHE_VERSION || head.recordSize != sizeof(Record)) {
+        ESP_LOGI(TAG, "Nothing cached");
+        return false;
+    }
+    size_t total = sizeof(Header) + head.count * sizeof(Record) + head.stringBytes;
+    if (total > part->size) {
+        ESP_LOGE(TAG, "Corrupt header");
+        return false;
+    }
+
+    const void* base = nullptr;
+    if (esp_partition_mmap(part, 0, total, ESP_PARTITION_MMAP_DATA, &base, &mapHandle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map %d bytes", (int)total);
+        return false;
+    }
+    mapped = true;
+    header = static_cast<const Header*>(base);
+    records = reinterpret_cast<const Record*>(static_cast<const uint8_t*>(base) + sizeof(Header));
+    strings = reinterpret_cast<const char*>(records + header->count);
+
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(records), header->count * sizeof(Record));
+    crc = esp_rom_crc32_le(crc, reinterpret_cast<const uint8_t*>(strings), header->stringBytes);
+    if (crc != header->crc || (header->stringBytes > 0 && strings[header->stringBytes - 1] != '\0')) {
+        ESP_LOGE(TAG, "Checksum mismatch, ignoring cache");
+        close();
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Mapped %d cached events for %.7s", (int)header->count, header->month);
+    return true;
+}
+
+void EventCache::close() {
+    if (mapped) {
+        esp_partition_munmap(mapHandle);
+        mapped = false;
+    }
+    header = nullptr;
+    records = nullptr;
+    strings = nullptr;
+}
+
+size_t EventCache::size() const {
+    return header ? header->count : 0;
+}
+
+const EventCache::Record& EventCache::record(size_t index) const {
+    return records[index];
+}
+
+const char* EventCache::string(uint32_t offset) const {
+    return offset < header->stringBytes ? strings + offset : "";
+}
+
+void EventCache::read(size_t index, CalendarEvent& event) const {
+    const Record& rec = records[index];
+    event.id = "";
+    event.summary = string(rec.summary);
+    event.description = string(rec.description);
+    event.organizerDisplayName = string(rec.organizer);
+    event.creatorEmail = string(rec.creator);
+    event.start = (time_t)rec.start;
+    event.end = (time_t)rec.end;
+    event.startDay = rec.startDay;
+    event.lastDay = rec.lastDay;
+    event.isAllDayEvent = (rec.flags & RECORD_ALL_DAY) != 0;
+    event.isCancelled = false;
+}
+
+CalendarEvent EventCache::operator[](size_t index) const {
+    CalendarEvent event;
+    read(index, event);
+    return event;
+}
+
+std::string EventCache::getMonth() const {
+    return header ? std::string(header->month, strnlen(header->month, sizeof(header->month))) : std::string();
+}
+
+time_t EventCache::getSavedAt() const {
+    return header ? (time_t)header->savedAt : 0;
+}
@@ -0,0 +1,144 @@
+#include "event_merge.hpp"
+#include <algorithm>
+#include <utility>
+#include "esp_log.h"
+#include "app_config.hpp"
+
+#if EVENT_MERGE_BENCHMARK
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "wake_arena.hpp"
+#endif
+
+static const char* TAG = "[Event Merge]";
+
+static bool startsBefore(const CalendarEvent& a, const CalendarEvent& b) {
+    return a.start < b.start;
+}
+
+namespace {
+// Next unmerged event of one stream
+struct Cursor {
+    EventList* stream;
+    size_t streamIndex;
+    size_t pos;
+};
+
+// Heap order, the earliest start (then the lowest stream index) on top
+struct Later {
+    bool operator()(const Cursor& a, const Cursor& b) const {
+        time_t startA = (*a.stream)[a.pos].start;
+        time_t startB = (*b.stream)[b.pos].start;
+        return startA != startB ? startA > startB : a.streamIndex > b.streamIndex;
+    }
+};
+} // namespace
+
+void EventMerge::mergeByStart(const std::vector<EventList*>& streams, EventList& out) {
+    std::vector<Cursor> heap;
+    heap.reserve(streams.size());
+    size_t total = 0;
+    for (size_t i = 0; i < streams.size(); i++) {
+        EventList& stream = *streams[i];
+        if (stream.empty()) {
+            continue;
+        }
+        // Every stream is sorted before it is stored, this is only a safety net
+        // and hitting it means a code path skipped that sort
+        if (!std::is_sorted(stream.begin(), stream.end(), startsBefore)) {
+            ESP_LOGW(TAG, "Stream %d arrived unsorted, sorting %d events", (int)i, (int)stream.size());
+            std::stable_sort(stream.begin(), stream.end(), startsBefore);
+        }
+        heap.push_back({&stream, i, 0});
+        total += stream.size();
+    }
+
+    out.reserve(out.size() + total);
+    std::make_heap(heap.begin(), heap.end(), Later());
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), Later());
+        Cursor& next = heap.back();
+        out.push_back(std::move((*next.stream)[next.pos]));
+        if (++next.pos < next.stream->size()) {
+            std::push_heap(heap.begin(), heap.end(), Later());
+        } else {
+            heap.pop_back();
+        }
+    }
+
+    for (EventList* stream : streams) {
+        stream->clear();
+    }
+}
+
+#if EVENT_MERGE_BENCHMARK
+
+// What Application did before the merge: every swap copies the event three times
+static void bubbleSort(EventList& events) {
+    for (size_t i = 0; i < events.size(); ++i) {
+        for (size_t j = 0; j < events.size() - i - 1; ++j) {
+            if (events[j].start > events[j + 1].start) {
+                CalendarEvent temp = events[j];
+                events[j] = events[j + 1];
+                events[j + 1] = temp;
+            }
+        }
+        // Seconds of sorting would otherwise starve the idle task watchdog
+        if ((i & 0xff) == 0xff) {
+            vTaskDelay(1);
+        }
+    }
+}
+
+void EventMerge::benchmark() {
+    const int sizes[] = {1000, 2000, 5000, 10000};
+    const int calendars = 4;
+
+    for (int count : sizes) {
+        // Sorted streams of random events within one month, as the API delivers them
+        std::vector<EventList> streams(calendars);
+        for (int i = 0; i < count; i++) {
+            CalendarEvent event;
+            event.start = 1727740800 + esp_random() % (31 * 86400);
+            event.end = event.start + 3600;
+            streams[i % calendars].push_back(event);
+        }
+        for (auto& stream : streams) {
+            std::sort(stream.begin(), stream.end(), startsBefore);
+        }
+
+        EventList bubbled;
+        int64_t start = esp_timer_get_time();
+        for (const auto& stream : streams) {
+            bubbled.insert(bubbled.end(), stream.begin(), stream.end());
+        }
+        std::reverse(bubbled.begin(), bubbled.end());
+        bubbleSort(bubbled);
+        int64_t bubbleUs = esp_timer_get_time() - start;
+
+        std::vector<EventList*> pointers;
+        for (auto& stream : streams) {
+            pointers.push_back(&stream);
+        }
+        EventList merged;
+        start = esp_timer_get_time();
+        mergeByStart(pointers, merged);
+        int64_t mergeUs = esp_timer_get_time() - start;
+
+        bool same = merged.size() == bubbled.size() &&
+                    std::equal(merged.begin(), merged.end(), bubbled.begin(),
+                               [](const CalendarEvent& a, const CalendarEvent& b) { return a.start == b.start; });
+        ESP_LOGI(TAG, "%5d events: bubble sort %lld ms, merge %lld us (%s)", count, bubbleUs / 1000, mergeUs,
+                 same ? "same order" : "ORDER DIFFERS");
+
+        // Nothing else lives in the arena yet, drop this round's lists
+        streams.clear();
+        bubbled = EventList();
+        merged = EventList();
+        WakeArena::shared().reset();
+    }
+}
+
+#endif // EVENT_MERGE_BENCHMARK
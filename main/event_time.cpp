@@ -0,0 +1,79 @@
+#include "event_time.hpp"
+
+// Howard Hinnant's days_from_civil
+int32_t EventTime::dayNumber(int year, int month, int day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400);
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static bool readNumber(const char*& p, int digits, int& value) {
+    value = 0;
+    for (int i = 0; i < digits; i++, p++) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    return true;
+}
+
+bool EventTime::parse(const char* text, time_t& epoch, int32_t& day) {
+    const char* p = text;
+    int year, month, mday;
+    if (!readNumber(p, 4, year) || *p++ != '-' || !readNumber(p, 2, month) || *p++ != '-' ||
+        !readNumber(p, 2, mday) || month < 1 || month > 12 || mday < 1 || mday > 31) {
+        return false;
+    }
+    day = dayNumber(year, month, mday);
+
+    struct tm timeinfo = {};
+    timeinfo.tm_year = year - 1900;
+    timeinfo.tm_mon = month - 1;
+    timeinfo.tm_mday = mday;
+    timeinfo.tm_isdst = -1;
+
+    if (*p == '\0') {
+        // All-day dates start at local midnight
+        epoch = mktime(&timeinfo);
+        return true;
+    }
+
+    int hour, minute, second;
+    if (*p++ != 'T' || !readNumber(p, 2, hour) || *p++ != ':' || !readNumber(p, 2, minute) || *p++ != ':' ||
+        !readNumber(p, 2, second)) {
+        return false;
+    }
+    if (*p == '.') {
+        do {
+            p++;
+        } while (*p >= '0' && *p <= '9');
+    }
+
+    if (*p == '\0') {
+        // No offset, the time is local
+        timeinfo.tm_hour = hour;
+        timeinfo.tm_min = minute;
+        timeinfo.tm_sec = second;
+        epoch = mktime(&timeinfo);
+        return true;
+    }
+
+    int offset = 0;
+    if (*p == '+' || *p == '-') {
+        int sign = *p++ == '-' ? -1 : 1;
+        int offsetHours, offsetMinutes;
+        if (!readNumber(p, 2, offsetHours) || *p++ != ':' || !readNumber(p, 2, offsetMinutes)) {
+            return false;
+        }
+        offset = sign * (offsetHours * 3600 + offsetMinutes * 60);
+    } else if (*p++ != 'Z') {
+        return false;
+    }
+
+    epoch = (time_t)day * 86400 + hour * 3600 + minute * 60 + second - offset;
+    return true;
+}
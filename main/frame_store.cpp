@@ -0,0 +1,157 @@
+#include "frame_store.hpp"
+#include <cstring>
+#include <esp_rom_crc.h>
+#include "esp_log.h"
+#include "wake_arena.hpp"
+
+static const char* TAG = "[Frame Store]";
+
+#define FRAME_MAGIC   0x46524d46 // "FMRF"
+#define FRAME_VERSION 1
+
+const esp_partition_t* FrameStore::partition() {
+    const esp_partition_t* part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           FRAME_STORE_PARTITION);
+    if (!part) {
+        ESP_LOGE(TAG, "No '%s' partition", FRAME_STORE_PARTITION);
+    }
+    return part;
+}
+
+// PackBits: a header byte n < 128 is followed by n + 1 literal bytes, n > 128
+// by one byte repeated 257 - n times. The white background packs 64:1 and
+// the worst case grows by one byte in 128.
+size_t FrameStore::pack(const uint8_t* in, size_t size, uint8_t* out) {
+    size_t o = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t run = 1;
+        while (i + run < size && run < 128 && in[i + run] == in[i]) {
+            run++;
+        }
+        if (run >= 2) {
+            out[o++] = (uint8_t)(257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next run of three
+        size_t start = i;
+        size_t len = 0;
+        while (i < size && len < 128) {
+            if (i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]) {
+                break;
+            }
+            i++;
+            len++;
+        }
+        out[o++] = (uint8_t)(len - 1);
+        memcpy(out + o, in + start, len);
+        o += len;
+    }
+    return o;
+}
+
+bool FrameStore::unpack(const uint8_t* in, size_t packedSize, uint8_t* out, size_t size) {
+    size_t i = 0;
+    size_t o = 0;
+    while (i < packedSize) {
+        uint8_t n = in[i++];
+        if (n < 128) {
+            size_t len = n + 1;
+            if (i + len > packedSize || o + len > size) {
+                return false;
+            }
+            memcpy(out + o, in + i, len);
+            i += len;
+            o += len;
+        } else if (n > 128) {
+            size_t len = 257 - n;
+            if (i >= packedSize || o + len > size) {
+                return false;
+            }
+            memset(out + o, in[i++], len);
+            o += len;
+        }
+    }
+    return o == size;
+}
+
+esp_err_t FrameStore::save(const uint8_t* fb, size_t size, uint32_t partialRefreshes) {
+    const esp_partition_t* part = partition();
+    if (!part) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t* packed = static_cast<uint8_t*>(WakeArena::shared().allocate(size + size / 128 + 1, 1));
+    size_t packedSize = pack(fb, size, packed);
+    size_t total = sizeof(Header) + packedSize;
+    if (total > part->size) {
+        ESP_LOGE(TAG, "Frame packs to %d bytes, partition has %d", (int)packedSize, (int)part->size);
+        invalidate();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    Header head = {};
+    head.magic = FRAME_MAGIC;
+    head.version = FRAME_VERSION;
+    head.rawSize = size;
+    head.packedSize = packedSize;
+    head.crc = esp_rom_crc32_le(0, packed, packedSize);
+    head.partialRefreshes = partialRefreshes;
+
+    size_t eraseSize = (total + part->erase_size - 1) / part->erase_size * part->erase_size;
+    esp_err_t err = esp_partition_erase_range(part, 0, eraseSize);
+
+    // Header goes in last, a write cut short leaves no valid magic behind
+    if (err == ESP_OK) err = esp_partition_write(part, sizeof(Header), packed, packedSize);
+    if (err == ESP_OK) err = esp_partition_write(part, 0, &head, sizeof(head));
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Saved frame: %d bytes packed to %d", (int)size, (int)packedSize);
+    } else {
+        ESP_LOGE(TAG, "Failed to save frame: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+bool FrameStore::load(uint8_t* fb, size_t size, uint32_t& partialRefreshes) {
+    const esp_partition_t* part = partition();
+    if (!part) {
+        return false;
+    }
+
+    Header head;
+    if (esp_partition_read(part, 0, &head, sizeof(head)) != ESP_OK || head.magic != FRAME_MAGIC ||
+        head.version != FRAME_VERSION || head.rawSize != size || sizeof(Header) + head.packedSize > part->size) {
+        ESP_LOGI(TAG, "No stored frame");
+        return false;
+    }
+
+    const void* base = nullptr;
+    esp_partition_mmap_handle_t handle;
+    if (esp_partition_mmap(part, 0, sizeof(Header) + head.packedSize, ESP_PARTITION_MMAP_DATA, &base, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map %d bytes", (int)head.packedSize);
+        return false;
+    }
+    const uint8_t* packed = static_cast<const uint8_t*>(base) + sizeof(Header);
+    bool ok = esp_rom_crc32_le(0, packed, head.packedSize) == head.crc && unpack(packed, head.packedSize, fb, size);
+    esp_partition_munmap(handle);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Stored frame is corrupt");
+        return false;
+    }
+    partialRefreshes = head.partialRefreshes;
+    ESP_LOGI(TAG, "Restored frame from %d bytes, %d partial refreshes since the last clean one", (int)head.packedSize,
+             (int)partialRefreshes);
+    return true;
+}
+
+void FrameStore::invalidate() {
+    const esp_partition_t* part = partition();
+    if (part) {
+        esp_partition_erase_range(part, 0, part->erase_size);
+    }
+}
@@ -1,10 +1,20 @@
 #include "g_calendar.hpp"
 #include "g_calendar_config.hpp"
+#include "g_calendar_parser.hpp"
+#include "g_calendar_store.hpp"
+#include "multipart_splitter.hpp"
+#include "event_time.hpp"
 #include <esp_http_client.h>
 #include <string>
+#include <algorithm>
 #include <ctime>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
 #include <nlohmann/json.hpp>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "app_config.hpp"
 
 static const char* TAG = "[Google Calendar]";
@@ -14,67 +24,60 @@ extern const char server_googleapis_root_cert_pem_end[] asm("_binary_server_goog
 
 using json = nlohmann::json;
 
-GoogleCalendar::GoogleCalendar(const std::string& clientId, const std::string& clientSecret, const std::string& refreshToken)
-    : clientId(clientId), clientSecret(clientSecret), refreshToken(refreshToken) {}
-
-static esp_err_t _http_event_handler(esp_http_client_event_t* evt) {
-      static char *output_buffer;  // Buffer to store response of http request from event handler
-    static int output_len;       // Stores number of bytes read
-    switch (evt->event_id) {
-        case HTTP_EVENT_ON_DATA:
-            ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
-            // Clean the buffer in case of a new request
-            if (output_len == 0 && evt->user_data) {
-                // we are just starting to copy the output data into the use
-                memset(evt->user_data, 0, MAX_HTTP_OUTPUT_BUFFER);
-            }
+// Only the fields CalendarEvent and the sync logic read; attendees, htmlLink,
+// reminders, conferenceData and etags make up most of a full event resource
+#define EVENT_FIELDS "items(id,status,summary,description,creator/email,organizer/displayName,start,end)," \
+                     "nextPageToken,nextSyncToken"
+
+// orderBy=startTime is never sent: it is not allowed together with syncToken,
+// and on the full listings that seed a token it can keep nextSyncToken from
+// being returned. Every listing seeds one, so sortByStart() orders on the device.
+
+// Totals across every GoogleCalendar since boot, updated by concurrent workers
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static int statRequests = 0;
+static size_t statBytes = 0;
+static int64_t statParseUs = 0;
+static size_t statEvents = 0;
+
+// Stored copies are kept in start time order, EventMerge relies on it
+static void sortByStart(EventList& events) {
+    std::stable_sort(events.begin(), events.end(), [](const CalendarEvent& a, const CalendarEvent& b) {
+        return a.start < b.start;
+    });
+}
 
-            if (evt->user_data) {
-                char* buffer = (char*)evt->user_data;
-                if (output_len + evt->data_len < MAX_HTTP_OUTPUT_BUFFER) {
-                    // Append data to the user-provided buffer
-                    memcpy(buffer + output_len, evt->data, evt->data_len);
-                } else {
-                    ESP_LOGE(TAG, "Buffer overflow, data truncated!");
-                }
-            }
+static void recordFetch(int requests, size_t bytes, int64_t parseUs, size_t events) {
+    portENTER_CRITICAL(&statsLock);
+    statRequests += requests;
+    statBytes += bytes;
+    statParseUs += parseUs;
+    statEvents += events;
+    portEXIT_CRITICAL(&statsLock);
+}
 
-              output_len += evt->data_len;
-            break;
-        case HTTP_EVENT_ON_HEADER:
-            if (strcasecmp(evt->header_key, "Content-Length") == 0) {
-                ESP_LOGI(TAG, "Content-Length: %s", evt->header_value);
-            }
-            break;
-        case HTTP_EVENT_ON_FINISH:
-             ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
-            if (output_buffer != NULL) {
-                free(output_buffer);
-                output_buffer = NULL;
-            }
-            output_len = 0;
-            break;
-        default:
-            break;
-    }
-    return ESP_OK;
+void GoogleCalendar::logStats() {
+    portENTER_CRITICAL(&statsLock);
+    int requests = statRequests;
+    size_t bytes = statBytes;
+    int64_t parseUs = statParseUs;
+    size_t events = statEvents;
+    portEXIT_CRITICAL(&statsLock);
+    ESP_LOGI(TAG, "Fetch stats: %d requests, %d bytes, %d events parsed in %lld ms",
+             requests, (int)bytes, (int)events, parseUs / 1000);
 }
 
-std::string GoogleCalendar::refreshAccessToken() {
-    const std::string url = "https://oauth2.googleapis.com/token";
+GoogleCalendar::GoogleCalendar(const std::string& clientId, const std::string& clientSecret, const std::string& refreshToken)
+    : clientId(clientId), clientSecret(clientSecret), refreshToken(refreshToken),
+      apiSession(GOOGLE_API_URL, server_googleapis_root_cert_pem_start,
+                 server_googleapis_root_cert_pem_end - server_googleapis_root_cert_pem_start),
+      oauthSession(GOOGLE_OAUTH_URL, server_googleapis_root_cert_pem_start,
+                   server_googleapis_root_cert_pem_end - server_googleapis_root_cert_pem_start) {}
+
+std::string GoogleCalendar::refreshAccessToken(int& expiresIn) {
+    const std::string url = GOOGLE_OAUTH_URL;
     std::string accessToken;
-
-    char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER + 1] = {0};
-
-    esp_http_client_config_t config = {};
-    config.url = url.c_str();
-    config.cert_pem = server_googleapis_root_cert_pem_start;
-    config.cert_len = server_googleapis_root_cert_pem_end - server_googleapis_root_cert_pem_start;
-    config.event_handler = _http_event_handler;
-    config.user_data = local_response_buffer;        // Pass address of local buffer to get response
-    config.disable_auto_redirect = true;
-    esp_log_level_set("*", ESP_LOG_DEBUG);
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    expiresIn = 0;
 
     std::string postData = 
         "client_id=" + CalendarConfig::getClientId() +
@@ -82,101 +85,470 @@ std::string GoogleCalendar::refreshAccessToken() {
         "&refresh_token=" + CalendarConfig::getRefreshToken() +
         "&grant_type=refresh_token";
 
-    esp_http_client_set_url(client, url.c_str());
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    esp_http_client_set_header(client, "Content-Type", "application/x-www-form-urlencoded");
-    esp_http_client_set_post_field(client, postData.c_str(), postData.length());
+    oauthSession.setHeader("Content-Type", "application/x-www-form-urlencoded");
+
+    // The body carries the client secret and refresh token, only its length is logged
+    ESP_LOGI(TAG, "Sending POST length: %d", (int)postData.length());
 
-    ESP_LOGI(TAG, "Sending POST Data: %s", postData.c_str());
-    ESP_LOGI(TAG, "Sending POST length: %d", postData.length());
+    HttpRequestContext context;
+    context.body = &responseArena;
 
-    if (esp_http_client_perform(client) == ESP_OK) {
-        int statusCode = esp_http_client_get_status_code(client);
-        if (statusCode == 200) {
-            json jsonResponse = json::parse(local_response_buffer);
+    if (oauthSession.perform(HTTP_METHOD_POST, url, context, postData) == ESP_OK) {
+        recordFetch(1, context.bytesReceived, 0, 0);
+        int statusCode = oauthSession.getStatusCode();
+        if (context.overflow) {
+            ESP_LOGE(TAG, "Buffer overflow, data truncated!");
+        } else if (statusCode == 200) {
+            json jsonResponse = json::parse(responseArena.c_str());
             if (jsonResponse.contains("access_token")) {
                 accessToken = jsonResponse["access_token"].get<std::string>();
                 CalendarConfig::setAccessToken(accessToken); // Update the access token
+                if (jsonResponse.contains("expires_in") && jsonResponse["expires_in"].is_number()) {
+                    expiresIn = jsonResponse["expires_in"].get<int>();
+                }
             } else {
                 ESP_LOGE(TAG, "Missing 'access_token' in the response.");
             }  
         }else{
-            ESP_LOGE(TAG, "HTTP status code: %d", statusCode);
+            ESP_LOGE(TAG, "HTTP status code: %d, %s", statusCode, responseArena.c_str());
         }
     }else{
         ESP_LOGE(TAG, "HTTP request failed.");
     }
 
-    esp_http_client_cleanup(client);
     return accessToken;
 }
 
+esp_err_t GoogleCalendar::syncEvents(const std::string& accessToken, const std::string& calendarId, EventList& events,
+                                     bool& unchanged) {
+    CalendarEventStore store(calendarId);
+    const std::string month = currentMonth();
+    unchanged = false;
 
-esp_err_t GoogleCalendar::getEvents(const std::string& accessToken, const std::string& calendarId, std::vector<CalendarEvent>& events) { 
-    
-    const std::string baseUrl = "https://www.googleapis.com/calendar/v3/calendars/";
-    const std::string timeRange = createTimeRange();
-    const std::string url = baseUrl + calendarId + "/events" + timeRange;
+    EventList stored;
+    std::string syncToken, storedMonth, etag;
+    bool incremental = store.load(syncToken, storedMonth, etag, stored) && storedMonth == month && !syncToken.empty();
 
     esp_err_t ret = ESP_OK;
-    
-    ESP_LOGI(TAG, "accessToken: %s", accessToken.c_str());
-
-    char local_response_buffer[MAX_HTTP_OUTPUT_BUFFER + 1] = {0};
-
-    esp_http_client_config_t config = {};
-    config.url = url.c_str();
-    config.timeout_ms = 10000;
-    config.cert_pem = server_googleapis_root_cert_pem_start;
-    config.cert_len = server_googleapis_root_cert_pem_end - server_googleapis_root_cert_pem_start;
-    config.event_handler = _http_event_handler;
-    config.user_data = local_response_buffer;        // Pass address of local buffer to get response
-    config.buffer_size_tx = MAX_HTTP_TX_BUFFER;
-    config.disable_auto_redirect = true;
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_http_client_set_header(client, "Authorization", ("Bearer " + accessToken).c_str());
-
-    if (esp_http_client_perform(client) == ESP_OK) {
-        int statusCode = esp_http_client_get_status_code(client);
-        if (statusCode == 200) {
-            parseEvents(local_response_buffer, events);
-        }else{
-            ret = ESP_ERR_HTTP_INVALID_TRANSPORT;
+    std::string nextSyncToken;
+    bool notModified = false;
+
+    if (incremental) {
+        ESP_LOGI(TAG, "Incremental sync for %s", calendarId.c_str());
+        EventList deltas;
+        ret = fetchEventPages(accessToken, calendarId, "?syncToken=" + urlEncode(syncToken), deltas, nextSyncToken,
+                              etag, notModified);
+        if (ret == ESP_OK && notModified) {
+            // Stored events, token and ETag are all still current
+            ESP_LOGI(TAG, "%s not modified", calendarId.c_str());
+            unchanged = true;
+            events.insert(events.end(), stored.begin(), stored.end());
+            return ESP_OK;
+        } else if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "Applying %d changes", (int)deltas.size());
+            applyDeltas(stored, deltas);
+            // The ETag answers ?syncToken=<old>, it is only sent again if that is the next query too
+            if (nextSyncToken != syncToken) {
+                etag.clear();
+            }
+        } else if (ret == ESP_ERR_INVALID_STATE) {
+            // Token expired on the server side, start over
+            ESP_LOGW(TAG, "Sync token rejected, falling back to a full sync");
+            store.clear();
+            incremental = false;
         }
-    }else{
-            ret = ESP_ERR_HTTP_CONNECT;
     }
 
-    esp_http_client_cleanup(client);
-    return ret;
+    if (!incremental) {
+        ESP_LOGI(TAG, "Full sync for %s", calendarId.c_str());
+        stored.clear();
+        // A full listing's ETag never matches a later sync query, so none is kept
+        etag.clear();
+        ret = fetchEventPages(accessToken, calendarId, createTimeRange(), stored, nextSyncToken, etag, notModified);
+        etag.clear();
+        stored.erase(std::remove_if(stored.begin(), stored.end(),
+                                    [](const CalendarEvent& event) { return event.isCancelled; }),
+                     stored.end());
+        sortByStart(stored);
+    }
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    store.save(nextSyncToken, month, etag, stored);
+    events.insert(events.end(), stored.begin(), stored.end());
+    return ESP_OK;
+}
+
+bool GoogleCalendar::loadStoredEvents(const std::string& calendarId, EventList& events) {
+    EventList stored;
+    std::string syncToken, month, etag;
+    if (!CalendarEventStore(calendarId).load(syncToken, month, etag, stored) || month != currentMonth()) {
+        return false;
+    }
+    events.insert(events.end(), stored.begin(), stored.end());
+    return true;
 }
 
-void GoogleCalendar::parseEvents(const std::string& payload, std::vector<CalendarEvent>& eventsVector) {
-    json response = json::parse(payload);
-
-    if (response.contains("items")) {
-        for (const auto& item : response["items"]) {
-            CalendarEvent calEvent;
-            calEvent.summary = item.value("summary", "");
-            calEvent.description = item.value("description", "");
-            calEvent.creatorEmail = item["creator"].value("email", "");
-            calEvent.organizerDisplayName = item["organizer"].value("displayName", "");
-
-            if (item["start"].contains("date")) {
-                calEvent.start = item["start"]["date"].get<std::string>();
-                calEvent.end = item["end"]["date"].get<std::string>();
-                calEvent.isAllDayEvent = true;
+// Sync state of one calendar taking part in a batch
+struct BatchItem {
+    CalendarFetchJob* job;
+    std::string month;
+    EventList stored;
+    std::string syncToken;
+    std::string etag;
+    bool incremental;
+
+    // Filled in from the item's part of the response
+    int statusCode;
+    bool parsed;
+    EventList fetched;
+    std::string pageToken;
+    std::string nextSyncToken;
+    std::string responseEtag;
+};
+
+esp_err_t GoogleCalendar::syncEventsBatch(const std::string& accessToken, std::vector<CalendarFetchJob>& jobs) {
+    const std::string month = currentMonth();
+    const std::string boundary = "fridge_calendar_batch";
+
+    std::vector<BatchItem> items;
+    for (auto& job : jobs) {
+        if (job.result == ESP_OK) {
+            continue;
+        }
+        BatchItem item;
+        item.job = &job;
+        item.month = month;
+        std::string storedMonth;
+        CalendarEventStore store(job.calendarId);
+        item.incremental = store.load(item.syncToken, storedMonth, item.etag, item.stored) &&
+                           storedMonth == month && !item.syncToken.empty();
+        item.statusCode = 0;
+        item.parsed = false;
+        items.push_back(std::move(item));
+    }
+    if (items.empty()) {
+        return ESP_OK;
+    }
+
+    // Each part is a complete GET, the outer Authorization header applies to all of them
+    std::string body;
+    for (size_t i = 0; i < items.size(); i++) {
+        const BatchItem& item = items[i];
+        std::string query = item.incremental ? "?syncToken=" + urlEncode(item.syncToken) : createTimeRange();
+        body += "--" + boundary + "\r\n"
+                "Content-Type: application/http\r\n"
+                "Content-ID: <item" + std::to_string(i) + ">\r\n\r\n"
+                "GET " + eventsPath(item.job->calendarId, query) + "\r\n";
+        if (item.incremental && !item.etag.empty()) {
+            body += "If-None-Match: " + item.etag + "\r\n";
+        }
+        body += "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+
+    // Parts arrive one after the other, so a single parser serves all of them
+    BatchItem* current = nullptr;
+    CalendarEventParser parser([&current](CalendarEvent& event) {
+        current->fetched.push_back(std::move(event));
+    });
+
+    MultipartSplitter splitter(
+        [&](const MultipartSplitter::Part& part) {
+            // Response parts are labelled "<response-itemN>"
+            size_t pos = part.contentId.find("item");
+            size_t index = pos == std::string::npos ? items.size() : (size_t)atoi(part.contentId.c_str() + pos + 4);
+            current = index < items.size() ? &items[index] : nullptr;
+            if (current) {
+                current->statusCode = part.statusCode;
+                current->responseEtag = part.etag;
+                parser.reset();
+            }
+        },
+        [&](const MultipartSplitter::Part& part, const char* data, size_t len) {
+            if (current && part.statusCode == 200) {
+                parser.feed(data, len);
+            }
+        },
+        [&](const MultipartSplitter::Part& part) {
+            if (current && part.statusCode == 200) {
+                current->parsed = parser.isComplete() && !parser.hasError();
+                current->pageToken = parser.nextPageToken();
+                current->nextSyncToken = parser.nextSyncToken();
+            }
+            current = nullptr;
+        });
+
+    HttpRequestContext context;
+    context.body = &responseArena;
+    bool started = false;
+    int64_t parseUs = 0;
+    auto feedSplitter = [&](const char* data, size_t len) {
+        // The response picks its own boundary, known once the headers are in
+        if (!started) {
+            splitter.reset(MultipartSplitter::boundaryFrom(context.contentType));
+            started = true;
+        }
+        int64_t start = esp_timer_get_time();
+        splitter.feed(data, len);
+        parseUs += esp_timer_get_time() - start;
+    };
+    context.sink = feedSplitter;
+
+#if GCAL_GZIP
+    GzipInflater inflater(feedSplitter);
+    context.inflater = &inflater;
+    apiSession.setHeader("Accept-Encoding", "gzip");
+    apiSession.setHeader("User-Agent", "Fridge-Calendar (gzip)");
+#endif
+
+    apiSession.setHeader("Authorization", "Bearer " + accessToken);
+    apiSession.setHeader("Content-Type", "multipart/mixed; boundary=" + boundary);
+    esp_err_t err = apiSession.perform(HTTP_METHOD_POST, GOOGLE_API_URL "/batch/calendar/v3", context, body);
+    apiSession.deleteHeader("Content-Type");
+    recordFetch(1, context.bytesReceived, parseUs, 0);
+
+    if (err != ESP_OK) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    int statusCode = apiSession.getStatusCode();
+    if (statusCode != 200) {
+        ESP_LOGE(TAG, "Batch HTTP status code: %d, %s", statusCode, responseArena.c_str());
+        return ESP_ERR_HTTP_INVALID_TRANSPORT;
+    }
+    if (context.decodeError || !splitter.isComplete()) {
+        ESP_LOGE(TAG, "Incomplete batch response (%d parts)", splitter.partCount());
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    ESP_LOGI(TAG, "Batch of %d calendars: %d bytes, %d parts", (int)items.size(), (int)context.bytesReceived,
+             splitter.partCount());
+
+    int completed = 0;
+    for (auto& item : items) {
+        CalendarFetchJob& job = *item.job;
+        CalendarEventStore store(job.calendarId);
+
+        if (item.statusCode == 304 && item.incremental && !item.etag.empty()) {
+            ESP_LOGI(TAG, "%s not modified", job.calendarId.c_str());
+            job.events.swap(item.stored);
+            job.unchanged = true;
+            job.result = ESP_OK;
+        } else if (item.statusCode == 200 && item.parsed && item.pageToken.empty()) {
+            recordFetch(0, 0, 0, item.fetched.size());
+            if (item.incremental) {
+                ESP_LOGI(TAG, "Applying %d changes", (int)item.fetched.size());
+                applyDeltas(item.stored, item.fetched);
             } else {
-                calEvent.start = item["start"]["dateTime"].get<std::string>();
-                calEvent.end = item["end"]["dateTime"].get<std::string>();
-                calEvent.isAllDayEvent = false;
+                item.stored.swap(item.fetched);
+                item.stored.erase(std::remove_if(item.stored.begin(), item.stored.end(),
+                                                 [](const CalendarEvent& event) { return event.isCancelled; }),
+                                  item.stored.end());
+                sortByStart(item.stored);
             }
+            // As in syncEvents, an ETag is only kept for a query that will be repeated
+            bool sameQuery = item.incremental && item.nextSyncToken == item.syncToken;
+            store.save(item.nextSyncToken, item.month, sameQuery ? item.responseEtag : std::string(), item.stored);
+            job.events.swap(item.stored);
+            job.unchanged = false;
+            job.result = ESP_OK;
+        } else if (item.statusCode == 410) {
+            // Sync token expired, the per-calendar fallback starts over
+            ESP_LOGW(TAG, "Sync token rejected for %s", job.calendarId.c_str());
+            store.clear();
+        } else if (item.statusCode == 200 && item.parsed) {
+            ESP_LOGI(TAG, "%s has more pages, fetching it on its own", job.calendarId.c_str());
+        } else {
+            ESP_LOGW(TAG, "Batch part for %s failed with status %d", job.calendarId.c_str(), item.statusCode);
+        }
+        completed += (job.result == ESP_OK);
+    }
 
-            eventsVector.push_back(calEvent);
+    ESP_LOGI(TAG, "Batch completed %d of %d calendars", completed, (int)items.size());
+    return completed == (int)items.size() ? ESP_OK : ESP_ERR_NOT_FINISHED;
+}
+
+void GoogleCalendar::applyDeltas(EventList& stored, EventList& deltas) {
+    // Deltas are not bounded by timeMin/timeMax, so anything outside this month is dropped
+    time_t now = time(nullptr);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    const int year = timeinfo.tm_year + 1900;
+    const int month = timeinfo.tm_mon + 1;
+    const int32_t monthStart = EventTime::dayNumber(year, month, 1);
+    const int32_t monthEnd = (month == 12 ? EventTime::dayNumber(year + 1, 1, 1) : EventTime::dayNumber(year, month + 1, 1)) - 1;
+
+    for (auto& delta : deltas) {
+        auto it = std::find_if(stored.begin(), stored.end(),
+                               [&delta](const CalendarEvent& event) { return strcmp(event.id, delta.id) == 0; });
+        bool inMonth = delta.startDay <= monthEnd && delta.lastDay >= monthStart;
+
+        if (delta.isCancelled || !inMonth) {
+            if (it != stored.end()) {
+                stored.erase(it);
+            }
+        } else if (it != stored.end()) {
+            *it = std::move(delta);
+        } else {
+            stored.push_back(std::move(delta));
+        }
+    }
+
+    sortByStart(stored);
+}
+
+esp_err_t GoogleCalendar::fetchEventPages(const std::string& accessToken, const std::string& calendarId, const std::string& query,
+                                          EventList& events, std::string& nextSyncToken,
+                                          std::string& etag, bool& notModified) {
+    const std::string firstPageUrl = GOOGLE_API_URL + eventsPath(calendarId, query);
+
+    esp_err_t ret = ESP_OK;
+
+    // Events are parsed straight out of the HTTP data callback
+    const size_t initialCount = events.size();
+    CalendarEventParser parser([&events](CalendarEvent& event) {
+        events.push_back(std::move(event));
+    });
+
+    int64_t parseUs = 0;
+    auto feedParser = [&parser, &parseUs](const char* data, size_t len) {
+        int64_t start = esp_timer_get_time();
+        parser.feed(data, len);
+        parseUs += esp_timer_get_time() - start;
+    };
+
+    // Error bodies are captured for the log
+    HttpRequestContext context;
+    context.body = &responseArena;
+    context.sink = feedParser;
+
+#if GCAL_GZIP
+    // Inflated output goes to the parser as it is produced. Google only
+    // compresses when the User-Agent also mentions gzip.
+    GzipInflater inflater(feedParser);
+    context.inflater = &inflater;
+    apiSession.setHeader("Accept-Encoding", "gzip");
+    apiSession.setHeader("User-Agent", "Fridge-Calendar (gzip)");
+#endif
+
+    apiSession.setHeader("Authorization", "Bearer " + accessToken);
+    notModified = false;
+
+    // Each page is fully parsed before the next one is requested
+    std::string pageToken;
+    int page = 0;
+    int requests = 0;
+    size_t totalBytes = 0;
+    size_t inflatedBytes = 0;
+    std::string responseEtag;
+    do {
+        std::string url = firstPageUrl;
+        if (!pageToken.empty()) {
+            url += "&pageToken=" + urlEncode(pageToken);
+        }
+        parser.reset();
+
+        // Only the first page is conditional, the header must not leak into later requests
+        if (page == 0 && !etag.empty()) {
+            apiSession.setHeader("If-None-Match", etag);
+        }
+        esp_err_t err = apiSession.perform(HTTP_METHOD_GET, url, context);
+        apiSession.deleteHeader("If-None-Match");
+        requests++;
+        if (err != ESP_OK) {
+            ret = ESP_ERR_HTTP_CONNECT;
+            break;
+        }
+
+        int statusCode = apiSession.getStatusCode();
+        if (statusCode == 304 && page == 0 && !etag.empty()) {
+            notModified = true;
+            break;
+        } else if (statusCode == 410) {
+            ret = ESP_ERR_INVALID_STATE; // Sync token no longer valid
+            break;
+        } else if (statusCode != 200) {
+            ESP_LOGE(TAG, "HTTP status code: %d, %s", statusCode, responseArena.c_str());
+            ret = ESP_ERR_HTTP_INVALID_TRANSPORT;
+            break;
+        }
+
+        if (context.decodeError || !parser.isComplete() || parser.hasError()) {
+            ESP_LOGE(TAG, "Incomplete events response for %s (page %d)", calendarId.c_str(), page);
+            ret = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+
+        ESP_LOGI(TAG, "Parsed %d events from %d bytes%s (page %d)", (int)parser.eventCount(), (int)context.bytesReceived,
+                 context.gzipEncoded ? " gzip" : "", page);
+        totalBytes += context.bytesReceived;
+#if GCAL_GZIP
+        if (context.gzipEncoded) {
+            inflatedBytes += inflater.getInflatedBytes();
+        } else {
+            inflatedBytes += context.bytesReceived;
+        }
+#endif
+        pageToken = parser.nextPageToken();
+        nextSyncToken = parser.nextSyncToken();
+        if (page == 0) {
+            responseEtag = context.etag;
+        }
+        page++;
+    } while (!pageToken.empty() && page < MAX_EVENT_PAGES);
+
+    // Compare with GCAL_FIELD_PROJECTION off to measure the savings
+    ESP_LOGI(TAG, "%s: %d bytes in %d pages (projection %s)", calendarId.c_str(), (int)totalBytes, page,
+             GCAL_FIELD_PROJECTION ? "on" : "off");
+#if GCAL_GZIP
+    ESP_LOGI(TAG, "%s: %d bytes after inflating", calendarId.c_str(), (int)inflatedBytes);
+#endif
+    recordFetch(requests, totalBytes, parseUs, events.size() - initialCount);
+
+    if (ret == ESP_OK && !pageToken.empty()) {
+        // Without the last page there is no sync token to trust
+        ESP_LOGW(TAG, "Stopped after %d pages for %s", page, calendarId.c_str());
+        nextSyncToken.clear();
+    }
+
+    // Drop whatever a failed response managed to emit
+    if (ret != ESP_OK) {
+        events.erase(events.begin() + initialCount, events.end());
+    }
+
+    // The first page's ETag says nothing about the pages after it
+    if (!notModified) {
+        etag = (ret == ESP_OK && page == 1) ? responseEtag : std::string();
+    }
+
+    return ret;
+}
+
+std::string GoogleCalendar::eventsPath(const std::string& calendarId, const std::string& query) {
+    std::string path = "/calendar/v3/calendars/" + calendarId + "/events" + query +
+                       "&singleEvents=true&maxResults=" + std::to_string(MAX_RESULTS_PER_PAGE);
+#if GCAL_FIELD_PROJECTION
+    path += "&fields=" EVENT_FIELDS;
+#endif
+    return path;
+}
+
+// Percent-encodes everything outside the RFC 3986 unreserved set
+std::string GoogleCalendar::urlEncode(const std::string& value) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(value.size());
+    for (unsigned char c : value) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0x0F];
         }
     }
+    return encoded;
 }
 
 std::string GoogleCalendar::createTimeRange() {
@@ -204,3 +576,14 @@ std::string GoogleCalendar::createTimeRange() {
 
     return "?timeMin=" + std::string(timeMin) + "&timeMax=" + std::string(timeMax);
 }
+
+std::string GoogleCalendar::currentMonth() {
+    time_t now;
+    struct tm timeinfo;
+    char month[8];
+
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    snprintf(month, sizeof(month), "%04d-%02d", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1);
+    return std::string(month);
+}
@@ -0,0 +1,276 @@
+#include "g_calendar_parser.hpp"
+#include <cstring>
+#include "event_time.hpp"
+#include "string_pool.hpp"
+
+CalendarEventParser::CalendarEventParser(EventSink sink) : sink(sink) {
+    reset();
+}
+
+void CalendarEventParser::reset() {
+    depth = 0;
+    expectKey = false;
+    inString = false;
+    stringIsKey = false;
+    escape = false;
+    unicodeDigits = 0;
+    unicodeValue = 0;
+    highSurrogate = 0;
+    keyLen = 0;
+    target = nullptr;
+    complete = false;
+    error = false;
+    emitted = 0;
+    pageToken.clear();
+    syncToken.clear();
+    resetEvent();
+}
+
+void CalendarEventParser::resetEvent() {
+    fields.id.clear();
+    fields.summary.clear();
+    fields.description.clear();
+    fields.creatorEmail.clear();
+    fields.organizerDisplayName.clear();
+    fields.start.clear();
+    fields.end.clear();
+    fields.status.clear();
+    hasStartDate = false;
+}
+
+void CalendarEventParser::emitEvent() {
+    StringPool& pool = StringPool::shared();
+    CalendarEvent event;
+    event.id = pool.store(fields.id);
+    event.summary = pool.intern(fields.summary);
+    event.description = pool.intern(fields.description);
+    event.creatorEmail = pool.intern(fields.creatorEmail);
+    event.organizerDisplayName = pool.intern(fields.organizerDisplayName);
+    event.isAllDayEvent = hasStartDate;
+    event.isCancelled = (fields.status == "cancelled");
+
+    // Cancellations come without times and keep zeros, they are only matched by ID
+    int32_t endDay = 0;
+    if (EventTime::parse(fields.start.c_str(), event.start, event.startDay) &&
+        EventTime::parse(fields.end.c_str(), event.end, endDay)) {
+        // An all-day event's end date is the day after it
+        event.lastDay = event.isAllDayEvent ? endDay - 1 : endDay;
+    }
+
+    sink(event);
+    emitted++;
+}
+
+// Root object -> "items" array -> event object
+bool CalendarEventParser::inItemsElement() const {
+    return depth >= 3 &&
+           stack[0].type == Container::Object && strcmp(stack[0].key, "items") == 0 &&
+           stack[1].type == Container::Array &&
+           stack[2].type == Container::Object;
+}
+
+void CalendarEventParser::openContainer(Container type) {
+    if (depth < PARSER_MAX_DEPTH) {
+        stack[depth].type = type;
+        stack[depth].key[0] = '\0';
+    }
+    depth++;
+    expectKey = (type == Container::Object);
+}
+
+void CalendarEventParser::closeContainer(Container type) {
+    if (depth == 0 || (depth <= PARSER_MAX_DEPTH && stack[depth - 1].type != type)) {
+        error = true;
+        return;
+    }
+
+    // An element of "items" just closed, hand the event over
+    if (depth == 3 && inItemsElement()) {
+        emitEvent();
+        resetEvent();
+    }
+
+    depth--;
+    expectKey = false;
+    if (depth == 0) {
+        complete = true;
+    }
+}
+
+// Picks the CalendarEvent field the upcoming string value belongs to
+std::string* CalendarEventParser::selectTarget() {
+    if (depth == 1 && stack[0].type == Container::Object) {
+        if (strcmp(stack[0].key, "nextPageToken") == 0) return &pageToken;
+        if (strcmp(stack[0].key, "nextSyncToken") == 0) return &syncToken;
+        return nullptr;
+    }
+
+    if (depth > PARSER_MAX_DEPTH || !inItemsElement()) {
+        return nullptr;
+    }
+
+    if (depth == 3) {
+        const char* key = stack[2].key;
+        if (strcmp(key, "id") == 0) return &fields.id;
+        if (strcmp(key, "status") == 0) return &fields.status;
+        if (strcmp(key, "summary") == 0) return &fields.summary;
+        if (strcmp(key, "description") == 0) return &fields.description;
+        return nullptr;
+    }
+
+    if (depth == 4 && stack[3].type == Container::Object) {
+        const char* parent = stack[2].key;
+        const char* key = stack[3].key;
+        if (strcmp(parent, "creator") == 0 && strcmp(key, "email") == 0) return &fields.creatorEmail;
+        if (strcmp(parent, "organizer") == 0 && strcmp(key, "displayName") == 0) return &fields.organizerDisplayName;
+
+        bool isStart = strcmp(parent, "start") == 0;
+        bool isEnd = strcmp(parent, "end") == 0;
+        if (isStart || isEnd) {
+            if (strcmp(key, "date") == 0) {
+                if (isStart) hasStartDate = true;
+                return isStart ? &fields.start : &fields.end;
+            }
+            // "date" wins over "dateTime" if both are present
+            if (strcmp(key, "dateTime") == 0 && !(isStart && hasStartDate)) {
+                return isStart ? &fields.start : &fields.end;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void CalendarEventParser::beginString() {
+    inString = true;
+    escape = false;
+    unicodeDigits = 0;
+    highSurrogate = 0;
+    stringIsKey = expectKey && depth > 0 && depth <= PARSER_MAX_DEPTH &&
+                  stack[depth - 1].type == Container::Object;
+    if (stringIsKey) {
+        keyLen = 0;
+        stack[depth - 1].key[0] = '\0';
+        target = nullptr;
+    } else {
+        target = selectTarget();
+        if (target) {
+            target->clear();
+        }
+    }
+}
+
+void CalendarEventParser::endString() {
+    inString = false;
+    if (stringIsKey) {
+        expectKey = false;
+    }
+    target = nullptr;
+}
+
+void CalendarEventParser::appendChar(char c) {
+    if (stringIsKey) {
+        Frame& frame = stack[depth - 1];
+        if (keyLen < PARSER_MAX_KEY_LEN) {
+            frame.key[keyLen++] = c;
+            frame.key[keyLen] = '\0';
+        } else {
+            frame.key[0] = '\0'; // Too long to be a key we care about
+        }
+    } else if (target && target->size() < PARSER_MAX_FIELD_LEN) {
+        target->push_back(c);
+    }
+}
+
+void CalendarEventParser::appendCodepoint(uint32_t cp) {
+    // Encode as UTF-8
+    if (cp < 0x80) {
+        appendChar(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+        appendChar(static_cast<char>(0xC0 | (cp >> 6)));
+        appendChar(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        appendChar(static_cast<char>(0xE0 | (cp >> 12)));
+        appendChar(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        appendChar(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+        appendChar(static_cast<char>(0xF0 | (cp >> 18)));
+        appendChar(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        appendChar(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        appendChar(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+void CalendarEventParser::feed(const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+
+        if (inString) {
+            if (unicodeDigits > 0) {
+                uint32_t digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+                else { error = true; digit = 0; }
+                unicodeValue = (unicodeValue << 4) | digit;
+
+                if (--unicodeDigits == 0) {
+                    if (unicodeValue >= 0xD800 && unicodeValue <= 0xDBFF) {
+                        highSurrogate = unicodeValue; // Wait for the low half
+                    } else if (unicodeValue >= 0xDC00 && unicodeValue <= 0xDFFF && highSurrogate) {
+                        appendCodepoint(0x10000 + ((highSurrogate - 0xD800) << 10) + (unicodeValue - 0xDC00));
+                        highSurrogate = 0;
+                    } else {
+                        appendCodepoint(unicodeValue);
+                        highSurrogate = 0;
+                    }
+                }
+            } else if (escape) {
+                escape = false;
+                switch (c) {
+                    case 'n': appendChar('\n'); break;
+                    case 'r': appendChar('\r'); break;
+                    case 't': appendChar('\t'); break;
+                    case 'b': appendChar('\b'); break;
+                    case 'f': appendChar('\f'); break;
+                    case 'u':
+                        unicodeDigits = 4;
+                        unicodeValue = 0;
+                        break;
+                    default:  appendChar(c); break; // \" \\ \/
+                }
+            } else if (c == '\\') {
+                escape = true;
+            } else if (c == '"') {
+                endString();
+            } else {
+                appendChar(c);
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '{':
+                openContainer(Container::Object);
+                break;
+            case '[':
+                openContainer(Container::Array);
+                break;
+            case '}':
+                closeContainer(Container::Object);
+                break;
+            case ']':
+                closeContainer(Container::Array);
+                break;
+            case '"':
+                beginString();
+                break;
+            case ',':
+                expectKey = depth > 0 && depth <= PARSER_MAX_DEPTH &&
+                            stack[depth - 1].type == Container::Object;
+                break;
+            default:
+                // ':' whitespace and bare literals (numbers, true, false, null) carry nothing we keep
+                break;
+        }
+    }
+}
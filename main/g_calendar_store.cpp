@@ -0,0 +1,263 @@
+#include "g_calendar_store.hpp"
+#include <cstdio>
+#include <cstring>
+#include <nvs_flash.h>
+#include <nvs.h>
+#include "esp_log.h"
+#include "string_pool.hpp"
+
+static const char* TAG = "[Calendar Store]";
+
+#define STORE_NAMESPACE "events"
+#define STORE_VERSION   2
+
+#define NVS_ENTRY_SIZE  32   // Bytes per NVS entry
+#define NVS_CHUNK_SIZE  4000 // Blob data per chunk, a chunk never spans pages
+
+// Entries a string or blob of this many bytes takes up, headers included
+static size_t entriesFor(size_t bytes) {
+    size_t chunks = bytes / NVS_CHUNK_SIZE + 1;
+    return (bytes + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE + chunks + 1;
+}
+
+esp_err_t CalendarEventStore::init() {
+    esp_err_t err = nvs_flash_init_partition(CALENDAR_STORE_PARTITION);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "Store partition truncated, erasing...");
+        ESP_ERROR_CHECK(nvs_flash_erase_partition(CALENDAR_STORE_PARTITION));
+        err = nvs_flash_init_partition(CALENDAR_STORE_PARTITION);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init store partition: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+CalendarEventStore::CalendarEventStore(const std::string& calendarId) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : calendarId) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+
+    char suffix[9];
+    snprintf(suffix, sizeof(suffix), "%08x", (unsigned int)hash);
+    tokenKey = std::string("tok_") + suffix;
+    monthKey = std::string("mon_") + suffix;
+    eventsKey = std::string("evt_") + suffix;
+    etagKey = std::string("etg_") + suffix;
+}
+
+bool CalendarEventStore::load(std::string& syncToken, std::string& month, std::string& etag, EventList& events) {
+    nvs_handle_t handle;
+    if (nvs_open_from_partition(CALENDAR_STORE_PARTITION, STORE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    bool loaded = false;
+    size_t tokenSize = 0, monthSize = 0, blobSize = 0;
+    if (nvs_get_str(handle, tokenKey.c_str(), nullptr, &tokenSize) == ESP_OK &&
+        nvs_get_str(handle, monthKey.c_str(), nullptr, &monthSize) == ESP_OK &&
+        nvs_get_blob(handle, eventsKey.c_str(), nullptr, &blobSize) == ESP_OK) {
+
+        std::vector<char> token(tokenSize), mon(monthSize);
+        std::vector<uint8_t> blob(blobSize);
+        if (nvs_get_str(handle, tokenKey.c_str(), token.data(), &tokenSize) == ESP_OK &&
+            nvs_get_str(handle, monthKey.c_str(), mon.data(), &monthSize) == ESP_OK &&
+            nvs_get_blob(handle, eventsKey.c_str(), blob.data(), &blobSize) == ESP_OK &&
+            deserialize(blob, events)) {
+            syncToken.assign(token.data());
+            month.assign(mon.data());
+            loaded = true;
+        }
+    }
+
+    // The ETag is optional, without it the next sync is simply unconditional
+    etag.clear();
+    size_t etagSize = 0;
+    if (loaded && nvs_get_str(handle, etagKey.c_str(), nullptr, &etagSize) == ESP_OK) {
+        std::vector<char> tag(etagSize);
+        if (nvs_get_str(handle, etagKey.c_str(), tag.data(), &etagSize) == ESP_OK) {
+            etag.assign(tag.data());
+        }
+    }
+    nvs_close(handle);
+
+    if (loaded) {
+        ESP_LOGI(TAG, "Loaded %d stored events for %s", (int)events.size(), month.c_str());
+    }
+    return loaded;
+}
+
+esp_err_t CalendarEventStore::save(const std::string& syncToken, const std::string& month, const std::string& etag,
+                                   const EventList& events) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(CALENDAR_STORE_PARTITION, STORE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open store: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    std::vector<uint8_t> blob;
+    serialize(events, blob);
+
+    // NVS writes the new blob before it erases the old one, so both have to
+    // fit. If they do not, this calendar's old copy goes first.
+    size_t needed = entriesFor(blob.size()) + entriesFor(month.size() + 1) + entriesFor(syncToken.size() + 1) +
+                    entriesFor(etag.size() + 1);
+    nvs_stats_t stats;
+    if (nvs_get_stats(CALENDAR_STORE_PARTITION, &stats) == ESP_OK && stats.available_entries < needed) {
+        ESP_LOGW(TAG, "%d bytes do not fit beside the stored copy, dropping it first", (int)blob.size());
+        eraseKeys(handle);
+        nvs_commit(handle);
+        if (nvs_get_stats(CALENDAR_STORE_PARTITION, &stats) == ESP_OK && stats.available_entries < needed) {
+            ESP_LOGE(TAG, "Not storing %d events (%d bytes): %d of %d entries needed are free", (int)events.size(),
+                     (int)blob.size(), (int)stats.available_entries, (int)needed);
+            nvs_close(handle);
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+
+    err = nvs_set_blob(handle, eventsKey.c_str(), blob.data(), blob.size());
+    if (err == ESP_OK) err = nvs_set_str(handle, monthKey.c_str(), month.c_str());
+    if (err == ESP_OK) err = nvs_set_str(handle, tokenKey.c_str(), syncToken.c_str());
+    if (err == ESP_OK) {
+        if (etag.empty()) {
+            nvs_erase_key(handle, etagKey.c_str());
+        } else {
+            err = nvs_set_str(handle, etagKey.c_str(), etag.c_str());
+        }
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+        ESP_LOGI(TAG, "Stored %d events (%d bytes)", (int)events.size(), (int)blob.size());
+    } else {
+        ESP_LOGE(TAG, "Failed to store events: %s", esp_err_to_name(err));
+        // A token or ETag without matching events must never be used
+        nvs_erase_key(handle, tokenKey.c_str());
+        nvs_erase_key(handle, etagKey.c_str());
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t CalendarEventStore::clear() {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open_from_partition(CALENDAR_STORE_PARTITION, STORE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    eraseKeys(handle);
+    err = nvs_commit(handle);
+    nvs_close(handle);
+    return err;
+}
+
+void CalendarEventStore::eraseKeys(nvs_handle_t handle) {
+    nvs_erase_key(handle, tokenKey.c_str());
+    nvs_erase_key(handle, monthKey.c_str());
+    nvs_erase_key(handle, eventsKey.c_str());
+    nvs_erase_key(handle, etagKey.c_str());
+}
+
+// Layout: version (1), count (2), then per event: flags (1), start and
+// end (8 each), startDay and lastDay (4 each), all little-endian, and
+// length-prefixed (2) id, summary, description, creatorEmail and
+// organizerDisplayName
+static void putNumber(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static bool getNumber(const std::vector<uint8_t>& in, size_t& pos, int bytes, uint64_t& value) {
+    if (pos + bytes > in.size()) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[pos + i] << (8 * i);
+    }
+    pos += bytes;
+    return true;
+}
+
+static void putString(std::vector<uint8_t>& out, const char* str) {
+    size_t size = strlen(str);
+    uint16_t len = size > 0xFFFF ? 0xFFFF : (uint16_t)size;
+    out.push_back(len & 0xFF);
+    out.push_back(len >> 8);
+    out.insert(out.end(), str, str + len);
+}
+
+static bool getString(const std::vector<uint8_t>& in, size_t& pos, const char*& str, bool intern) {
+    if (pos + 2 > in.size()) {
+        return false;
+    }
+    uint16_t len = in[pos] | (in[pos + 1] << 8);
+    pos += 2;
+    if (pos + len > in.size()) {
+        return false;
+    }
+    const char* data = reinterpret_cast<const char*>(in.data() + pos);
+    str = intern ? StringPool::shared().intern(data, len) : StringPool::shared().store(data, len);
+    pos += len;
+    return true;
+}
+
+void CalendarEventStore::serialize(const EventList& events, std::vector<uint8_t>& out) {
+    out.clear();
+    out.push_back(STORE_VERSION);
+    out.push_back(events.size() & 0xFF);
+    out.push_back((events.size() >> 8) & 0xFF);
+    for (const auto& event : events) {
+        out.push_back(event.isAllDayEvent ? 1 : 0);
+        putNumber(out, (uint64_t)(int64_t)event.start, 8);
+        putNumber(out, (uint64_t)(int64_t)event.end, 8);
+        putNumber(out, (uint32_t)event.startDay, 4);
+        putNumber(out, (uint32_t)event.lastDay, 4);
+        putString(out, event.id);
+        putString(out, event.summary);
+        putString(out, event.description);
+        putString(out, event.creatorEmail);
+        putString(out, event.organizerDisplayName);
+    }
+}
+
+bool CalendarEventStore::deserialize(const std::vector<uint8_t>& in, EventList& events) {
+    if (in.size() < 3 || in[0] != STORE_VERSION) {
+        return false;
+    }
+    size_t count = in[1] | (in[2] << 8);
+    size_t pos = 3;
+
+    events.clear();
+    events.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (pos >= in.size()) {
+            return false;
+        }
+        CalendarEvent event;
+        event.isAllDayEvent = in[pos++] != 0;
+        uint64_t start, end, startDay, lastDay;
+        if (!getNumber(in, pos, 8, start) ||
+            !getNumber(in, pos, 8, end) ||
+            !getNumber(in, pos, 4, startDay) ||
+            !getNumber(in, pos, 4, lastDay) ||
+            !getString(in, pos, event.id, false) ||
+            !getString(in, pos, event.summary, true) ||
+            !getString(in, pos, event.description, true) ||
+            !getString(in, pos, event.creatorEmail, true) ||
+            !getString(in, pos, event.organizerDisplayName, true)) {
+            return false;
+        }
+        event.start = (time_t)(int64_t)start;
+        event.end = (time_t)(int64_t)end;
+        event.startDay = (int32_t)(uint32_t)startDay;
+        event.lastDay = (int32_t)(uint32_t)lastDay;
+        events.push_back(event);
+    }
+    return true;
+}
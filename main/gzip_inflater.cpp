@@ -0,0 +1,161 @@
+#include "gzip_inflater.hpp"
+#include <esp_heap_caps.h>
+#include "miniz.h"
+#include "esp_log.h"
+
+static const char* TAG = "[Gzip]";
+
+#define GZIP_FLAG_FHCRC    0x02
+#define GZIP_FLAG_FEXTRA   0x04
+#define GZIP_FLAG_FNAME    0x08
+#define GZIP_FLAG_FCOMMENT 0x10
+#define GZIP_HEADER_LEN    10
+
+GzipInflater::GzipInflater(Sink sink)
+    : sink(sink), state(State::Header), flags(0), fieldPos(0), extraLen(0),
+      windowPos(0), inflatedBytes(0), decompressor(nullptr), window(nullptr) {}
+
+GzipInflater::~GzipInflater() {
+    heap_caps_free(decompressor);
+    heap_caps_free(window);
+}
+
+bool GzipInflater::reset() {
+    // Both live in PSRAM, they are only touched once per incoming chunk
+    if (!decompressor) {
+        decompressor = heap_caps_malloc(sizeof(tinfl_decompressor), MALLOC_CAP_SPIRAM);
+    }
+    if (!window) {
+        window = static_cast<uint8_t*>(heap_caps_malloc(TINFL_LZ_DICT_SIZE, MALLOC_CAP_SPIRAM));
+    }
+    if (!decompressor || !window) {
+        ESP_LOGE(TAG, "Failed to allocate inflate window");
+        state = State::Error;
+        return false;
+    }
+
+    tinfl_init(static_cast<tinfl_decompressor*>(decompressor));
+    state = State::Header;
+    flags = 0;
+    fieldPos = 0;
+    extraLen = 0;
+    windowPos = 0;
+    inflatedBytes = 0;
+    return true;
+}
+
+// Moves on to the next optional header field announced in the flags
+void GzipInflater::nextHeaderField() {
+    fieldPos = 0;
+    if (state == State::Header && (flags & GZIP_FLAG_FEXTRA)) {
+        state = State::ExtraLen;
+    } else if (state <= State::Extra && (flags & GZIP_FLAG_FNAME)) {
+        state = State::Name;
+    } else if (state <= State::Name && (flags & GZIP_FLAG_FCOMMENT)) {
+        state = State::Comment;
+    } else if (state <= State::Comment && (flags & GZIP_FLAG_FHCRC)) {
+        state = State::HeaderCrc;
+    } else {
+        state = State::Deflate;
+    }
+}
+
+bool GzipInflater::feed(const char* data, size_t len) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+
+    while (len > 0) {
+        switch (state) {
+            case State::Header: {
+                uint8_t c = *in++;
+                len--;
+                if ((fieldPos == 0 && c != 0x1f) || (fieldPos == 1 && c != 0x8b) || (fieldPos == 2 && c != 8)) {
+                    ESP_LOGE(TAG, "Not a gzip stream");
+                    state = State::Error;
+                    return false;
+                }
+                if (fieldPos == 3) {
+                    flags = c;
+                }
+                if (++fieldPos == GZIP_HEADER_LEN) {
+                    nextHeaderField();
+                }
+                break;
+            }
+            case State::ExtraLen:
+                extraLen |= static_cast<size_t>(*in++) << (8 * fieldPos);
+                len--;
+                if (++fieldPos == 2) {
+                    fieldPos = 0;
+                    state = State::Extra;
+                    if (extraLen == 0) {
+                        nextHeaderField();
+                    }
+                }
+                break;
+            case State::Extra: {
+                size_t skip = extraLen - fieldPos < len ? extraLen - fieldPos : len;
+                in += skip;
+                len -= skip;
+                fieldPos += skip;
+                if (fieldPos == extraLen) {
+                    nextHeaderField();
+                }
+                break;
+            }
+            case State::Name:
+            case State::Comment:
+                len--;
+                if (*in++ == 0) {
+                    nextHeaderField();
+                }
+                break;
+            case State::HeaderCrc:
+                in++;
+                len--;
+                if (++fieldPos == 2) {
+                    nextHeaderField();
+                }
+                break;
+            case State::Deflate:
+                return inflate(in, len);
+            case State::Done:
+                return true;
+            case State::Error:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool GzipInflater::inflate(const uint8_t* data, size_t len) {
+    tinfl_decompressor* inflater = static_cast<tinfl_decompressor*>(decompressor);
+
+    while (true) {
+        size_t inSize = len;
+        size_t outSize = TINFL_LZ_DICT_SIZE - windowPos;
+        tinfl_status status = tinfl_decompress(inflater, data, &inSize, window, window + windowPos, &outSize,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        data += inSize;
+        len -= inSize;
+
+        if (outSize > 0) {
+            sink(reinterpret_cast<const char*>(window + windowPos), outSize);
+            inflatedBytes += outSize;
+            windowPos = (windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            state = State::Done;
+            return true;
+        }
+        if (status < 0) {
+            ESP_LOGE(TAG, "Inflate failed: %d", status);
+            state = State::Error;
+            return false;
+        }
+        // Keep going while there is input left or the window was filled up
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,176 @@
+#include "http_session.hpp"
+#include "tls_resume_transport.hpp"
+#include <cstring>
+#include "esp_log.h"
+#include "app_config.hpp"
+
+static const char* TAG = "[HTTP Session]";
+
+void HttpRequestContext::reset() {
+    overflow = false;
+    bytesReceived = 0;
+    gzipEncoded = false;
+    decodeError = false;
+    etag.clear();
+    contentType.clear();
+    if (body) {
+        body->clear();
+    }
+}
+
+HttpSession::HttpSession(const char* url, const char* certPem, size_t certLen)
+    : url(url), certPem(certPem), certLen(certLen), client(nullptr), transport(nullptr),
+      requestCount(0) {}
+
+HttpSession::~HttpSession() {
+    if (client) {
+        ESP_LOGI(TAG, "Closing %s after %d requests", url, requestCount);
+    }
+    close();
+}
+
+bool HttpSession::open() {
+    if (client) {
+        return true;
+    }
+
+    esp_http_client_config_t config = {};
+    config.url = url;
+    config.timeout_ms = 10000;
+    config.cert_pem = certPem;
+    config.cert_len = certLen;
+    config.event_handler = eventHandler;
+    config.buffer_size = MAX_HTTP_RECV_BUFFER;
+    config.buffer_size_tx = MAX_HTTP_TX_BUFFER;
+    config.disable_auto_redirect = true;
+    config.keep_alive_enable = true;
+
+#ifdef CONFIG_ESP_HTTP_CLIENT_ENABLE_CUSTOM_TRANSPORT
+    // Offer the TLS session cached before deep sleep instead of a full handshake
+    if (strncmp(url, "https://", 8) == 0) {
+        transport = TlsResumeTransport::create(certPem, certLen);
+        config.transport = transport;
+    }
+#endif
+
+    client = esp_http_client_init(&config);
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to create client for %s", url);
+        return false;
+    }
+    return true;
+}
+
+void HttpSession::close() {
+    if (client) {
+        esp_http_client_cleanup(client);
+        client = nullptr;
+    }
+    // The client only borrows the transport, so it goes after the client
+    if (transport) {
+        esp_transport_destroy(transport);
+        transport = nullptr;
+    }
+}
+
+esp_err_t HttpSession::perform(esp_http_client_method_t method, const std::string& requestUrl,
+                               HttpRequestContext& context, const std::string& postData) {
+    if (!open()) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+
+    context.reset();
+    esp_http_client_set_user_data(client, &context);
+
+    // The connection stays up as long as the host does not change
+    esp_http_client_set_url(client, requestUrl.c_str());
+    esp_http_client_set_method(client, method);
+    if (postData.empty()) {
+        esp_http_client_set_post_field(client, nullptr, 0);
+    } else {
+        esp_http_client_set_post_field(client, postData.c_str(), postData.length());
+    }
+
+    esp_err_t err = esp_http_client_perform(client);
+    requestCount++;
+
+    // Late events (e.g. a disconnect) must not reach a context that is gone
+    esp_http_client_set_user_data(client, nullptr);
+
+    if (err != ESP_OK) {
+        // Start from a clean connection next time
+        ESP_LOGW(TAG, "Request failed: %s", esp_err_to_name(err));
+        esp_http_client_close(client);
+    }
+    return err;
+}
+
+void HttpSession::setHeader(const char* key, const std::string& value) {
+    if (open()) {
+        esp_http_client_set_header(client, key, value.c_str());
+    }
+}
+
+void HttpSession::deleteHeader(const char* key) {
+    if (client) {
+        esp_http_client_delete_header(client, key);
+    }
+}
+
+int HttpSession::getStatusCode() {
+    return client ? esp_http_client_get_status_code(client) : 0;
+}
+
+esp_err_t HttpSession::eventHandler(esp_http_client_event_t* evt) {
+    HttpRequestContext* context = static_cast<HttpRequestContext*>(evt->user_data);
+    if (!context) {
+        return ESP_OK;
+    }
+
+    switch (evt->event_id) {
+        case HTTP_EVENT_ON_DATA: {
+            ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d", evt->data_len);
+            const char* data = static_cast<const char*>(evt->data);
+            size_t len = evt->data_len;
+            context->bytesReceived += len;
+
+            // Error bodies are never streamed, they go to the arena for logging
+            if (context->sink && esp_http_client_get_status_code(evt->client) == 200) {
+                if (!context->gzipEncoded) {
+                    context->sink(data, len);
+                } else if (!context->decodeError && !context->inflater->feed(data, len)) {
+                    ESP_LOGE(TAG, "Corrupt gzip body");
+                    context->decodeError = true;
+                }
+            } else if (context->body && !context->gzipEncoded) {
+                if (!context->body->append(data, len)) {
+                    context->overflow = true;
+                }
+            }
+            break;
+        }
+        case HTTP_EVENT_ON_HEADER:
+            if (strcasecmp(evt->header_key, "Content-Length") == 0) {
+                ESP_LOGI(TAG, "Content-Length: %s", evt->header_value);
+            } else if (strcasecmp(evt->header_key, "ETag") == 0) {
+                context->etag = evt->header_value;
+            } else if (strcasecmp(evt->header_key, "Content-Type") == 0) {
+                context->contentType = evt->header_value;
+            } else if (strcasecmp(evt->header_key, "Content-Encoding") == 0 &&
+                       strcasecmp(evt->header_value, "gzip") == 0) {
+                // Only honoured when the caller can inflate, identity bodies pass through untouched
+                if (context->inflater && context->inflater->reset()) {
+                    context->gzipEncoded = true;
+                } else {
+                    context->decodeError = true;
+                }
+            }
+            break;
+        case HTTP_EVENT_ON_FINISH:
+            ESP_LOGD(TAG, "HTTP_EVENT_ON_FINISH");
+            break;
+        default:
+            break;
+    }
+    return ESP_OK;
+}
@@ -7,7 +7,49 @@
 // HTTP Configuration
 #define MAX_HTTP_RECV_BUFFER    512
 #define MAX_HTTP_TX_BUFFER      2048
-#define MAX_HTTP_OUTPUT_BUFFER  12800
+#define RESPONSE_ARENA_CHUNK    4096        // PSRAM response arena grows in steps of this
+#define RESPONSE_ARENA_MAX      (64 * 1024) // Bodies beyond this are truncated
+#define WAKE_ARENA_BLOCK        (32 * 1024) // Events, their text and layout scratch live in PSRAM blocks of this size
+
+// Google endpoints. Point both at tools/mock_gcal_server.py (plain http:// works)
+// to run the fetch pipeline without a Google account.
+#define GOOGLE_API_URL          "https://www.googleapis.com"
+#define GOOGLE_OAUTH_URL        "https://oauth2.googleapis.com/token"
+
+// Google Calendar paging
+#define MAX_RESULTS_PER_PAGE    50  // maxResults for each events page
+#define MAX_EVENT_PAGES         20  // Safety cap on pages fetched per calendar
+#define GCAL_FIELD_PROJECTION   1   // Ask only for the event fields we use (0 to compare payload sizes)
+#define GCAL_GZIP               1   // Accept gzip event pages and inflate them while parsing
+#define GCAL_BATCH              1   // Fetch all calendars in one batch request before falling back to one each
+
+// OAuth access token
+#define TOKEN_REFRESH_MARGIN    300    // Seconds before expiry a token is already treated as stale
+
+// Calendar fetch worker pool
+#define FETCH_WORKER_COUNT      2      // Including the calling task, never more than there are calendars
+#define FETCH_WORKER_STACK      10240  // Room for a TLS handshake
+
+// Retries
+#define WIFI_CONNECT_TIMEOUT_MS 30000  // A wake without Wi-Fi counts as a failed fetch
+#define FETCH_RETRY_ATTEMPTS    3      // In-process retries of failed calendars per wake
+#define FETCH_RETRY_BASE_MS     2000   // Backoff doubles from here, with jitter
+#define FETCH_RETRY_MAX_MS      30000
+#define RETRY_SLEEP_BASE_S      300    // Deep sleep after the first failed wake, doubles per failure
+#define RETRY_SLEEP_MAX_S       (4 * 3600)
+
+// Display
+#define FRAME_TILE                16  // Pixels per side of the tiles a new frame is diffed against the last in
+#define FRAME_FAST_PERCENT        10  // Diffed black and white changes under this share of the screen use the DU waveform
+#define FRAME_CLEAN_REFRESH_EVERY 7   // Diffed frames between full clear refreshes, against ghosting
+#define TEMPERATURE_VALID_MS      (10 * 60 * 1000) // A panel temperature reading is reused this long
+#define PANEL_MIN_TEMP_C          0   // Waveforms are made for this range, a frame drawn
+#define PANEL_MAX_TEMP_C          50  // outside of it is redrawn after TEMPERATURE_RETRY_S
+#define TEMPERATURE_RETRY_S       3600
+#define TEMPERATURE_RETRIES_PER_DAY 3 // Out-of-range redraws per day, then the normal schedule applies
+
+// Diagnostics
+#define EVENT_MERGE_BENCHMARK   0      // Time the old bubble sort against the event merge at boot (1k to 10k events)
 
 // Google Calendar 
 #define _clientId        "<your_client_id>"
@@ -7,6 +7,7 @@
 #include "epaper.hpp"
 #include "wifi.hpp"
 #include "localtime.hpp"
+#include "day_index.hpp"
 
 class Application {
 public:
@@ -15,18 +16,28 @@ public:
     void run(); // Main application logic
 
 private:
+    using LineList = std::vector<const char*, ArenaAllocator<const char*>>;
+
     EventGroupHandle_t event_group;
     WiFi wifi;
     EPaper epaper;
     LocalTime localTime;
 
-    std::string incrementDate(const std::string& date);
-    bool isDateWithinRange(const std::string& date, const CalendarEvent& event);
-    void printEventsInRange(const std::vector<CalendarEvent>& events, const std::string& start, const std::string& end);
-    void printEventSummary(const std::vector<CalendarEvent>& events, const std::string& startDate);
+    // Events is an EventList or an EventCache
+    template <typename Events>
+    void drawCalendar(const Events& events, const std::string& footer);
+    bool drawFromCache();
+    bool takeTemperatureRetry(const std::string& today);
+    template <typename Events>
+    void printEventsInRange(const Events& events, const DayIndex& index);
+    template <typename Events>
+    void printEventSummary(const Events& events, int32_t startDay);
     void storeDataInNVS(const std::string& key, const std::string& data);
     std::string getDataFromNVS(const std::string& key);
-    esp_err_t fetchCalendarEvents(std::vector<CalendarEvent>& events);
-    void sortEventsByStartDate(std::vector<CalendarEvent>& events);
-    std::vector<std::string> truncateString(const std::string& str,  size_t maxLength, size_t maxLines);
+    esp_err_t fetchCalendarEvents(EventList& events, bool& unchanged);
+    bool isAccessTokenStale();
+    std::string refreshAccessToken();
+    void runFetchPool(GoogleCalendar& gCalendar, std::vector<CalendarFetchJob>& jobs, const std::string& accessToken);
+    LineList truncateString(const char* str,  size_t maxLength, size_t maxLines);
+    void hibernate(uint32_t seconds);
 };
@@ -0,0 +1,44 @@
+#ifndef DAY_INDEX_HPP
+#define DAY_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "g_calendar.hpp"
+#include "wake_arena.hpp"
+
+// Buckets the events of a list by the days they are shown on, multi-day
+// events in every day they span. Built in one pass over the events, after
+// which drawing the grid reads each day's bucket instead of scanning the
+// whole list per day. Buckets are stored back to back (offsets + entries).
+class DayIndex {
+public:
+    // Indices into the event list, in list order
+    struct Bucket {
+        const uint32_t* first;
+        const uint32_t* last;
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+    };
+
+    // Covers the civil days [firstDay, firstDay + dayCount). Events is an
+    // EventList or an EventCache, indices refer to it.
+    template <typename Events>
+    DayIndex(const Events& events, int32_t firstDay, int dayCount);
+
+    // Empty for days outside the range
+    Bucket eventsOn(int32_t day) const;
+
+    int32_t getFirstDay() const { return firstDay; }
+    int getDayCount() const { return dayCount; }
+
+private:
+    int32_t firstDay;
+    int dayCount;
+    std::vector<uint32_t, ArenaAllocator<uint32_t>> offsets; // dayCount + 1 bucket bounds
+    std::vector<uint32_t, ArenaAllocator<uint32_t>> entries;
+};
+
+#endif // DAY_INDEX_HPP
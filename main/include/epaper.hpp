@@ -5,7 +5,9 @@
 #include <epdiy.h>
 #include <epd_highlevel.h>
 #include <stdio.h>
+#include <vector>
 #include "esp_log.h"
+#include "wake_arena.hpp"
 #include "OpenSans_Condensed-Bold-8.h"
 #include "OpenSans_SemiCondensed-Bold-10.h"
 #include "OpenSans_SemiCondensed-Bold-12.h"
@@ -30,6 +32,21 @@ public:
         int y;
     };
 
+    // Keeps the panel's high-voltage rails up while it exists, so a burst of
+    // updates pays for powering up and settling once. Sessions nest and the
+    // rails go down when the outermost one ends.
+    class PowerSession {
+    public:
+        explicit PowerSession(EPaper& epaper);
+        ~PowerSession();
+
+        PowerSession(const PowerSession&) = delete;
+        PowerSession& operator=(const PowerSession&) = delete;
+
+    private:
+        EPaper& epaper;
+    };
+
     const EpdFont* font_tiny = &OpenSans_8;
     const EpdFont* font_sml = &OpenSans_10;
     const EpdFont* font_mid = &OpenSans_12;
@@ -50,18 +67,71 @@ public:
     void drawCalendarBase(int offset_pos, int max_date, const char* title, int t_day);
     Coordinates getCoordinatesForDay(int day);
     void drawTextInSlot(int slot, int cursor_x, int cursor_y, const char *text);
-    void invalidate();
+
+    // Draws are only recorded. commit() renders everything recorded since
+    // the last one into the framebuffer and updates just the areas it
+    // touched, coalesced into as few panel updates as pay off, so each
+    // declared phase (a boot step, a whole calendar) costs one refresh.
+    void commit();
+
+    // Keeps what the panel shows for the next wake to diff against
+    void saveFrame();
+
+    // Time the rails were up and how often they were switched on this wake
+    void logPowerStats();
+
+    // Degrees Celsius for waveform selection and sleep scheduling, cached
+    // for TEMPERATURE_VALID_MS so a wake reads the sensor about once
+    int ambientTemperature();
 
 private:
     const uint8_t white = 0xFF;
     const uint8_t black = 0x0;
     EpdiyHighlevelState hl;        // High-level EPD handler
-    int temp;        // Ambient temperature
+    int temp;            // Ambient temperature, read at most once per TEMPERATURE_VALID_MS
+    int64_t tempReadAt;
+    bool tempValid;
     uint8_t* fb;     // Framebuffer
     Coordinates day_coords[MAX_DAYS + 1]; // Array to store coordinates for each day (1 to 31)
 
+    // One recorded primitive of the display list
+    struct DrawOp {
+        enum class Kind : uint8_t { Text, FillRect, StrokeRect, Image };
+        Kind kind;
+        uint8_t color;
+        EpdRect rect;             // Shape or image area, text origin in x and y
+        const EpdFont* font;
+        EpdFontProperties props;
+        const char* text;         // Copied into the WakeArena
+        const uint8_t* image;
+    };
+
+    std::vector<DrawOp, ArenaAllocator<DrawOp>> ops;
+    std::vector<EpdRect, ArenaAllocator<EpdRect>> dirtyRects; // Rendered but not on the panel yet
+    bool frameKnown;           // The front buffer matches the panel
+    bool frameStored;          // FrameStore holds the current picture
+    bool frameChanged;         // The panel changed since it was restored
+    bool diffFrame;            // Commit by diffing against the front buffer
+    uint32_t partialRefreshes; // Frames diffed in since the last clean refresh
+    int powerDepth;            // Open PowerSessions
+    int64_t powerOnSince;
+    int64_t powerOnUs;         // Rail-on time of this wake
+    int powerCycles;
+
     void checkError(enum EpdDrawError err);
-    void draw_progress_bar(int x, int y, int width, int percent, uint8_t* fb);
+    void draw_progress_bar(int x, int y, int width, int percent);
+    void addText(const EpdFont* font, const EpdFontProperties& props, int x, int y, const char* text);
+    void addRect(DrawOp::Kind kind, EpdRect rect, uint8_t color);
+    void addImage(EpdRect rect, const uint8_t* image);
+    void render();
+    void clearPanel();
+    void beginFrame();
+    size_t frameSize();
+    EpdRect rotatedRect(const EpdRect& native);
+    int diffTiles(bool& blackWhite);
+    EpdRect bounds(const DrawOp& op);
+    int updateCost(const EpdRect& r);
+    void coalesce();
     
 };
 
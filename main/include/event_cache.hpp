@@ -0,0 +1,83 @@
+#ifndef EVENT_CACHE_HPP
+#define EVENT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <esp_partition.h>
+#include "esp_err.h"
+#include "g_calendar.hpp"
+
+#define EVENT_CACHE_PARTITION "evcache"
+
+// The merged event list of the last fully successful fetch, kept in a raw
+// flash partition so the panel can be drawn without the network. Events are
+// fixed-width records pointing into a table of NUL-terminated strings, read
+// in place through a memory mapping instead of being copied into RAM.
+class EventCache {
+public:
+    // Times as in CalendarEvent, text as offsets into the string table
+    struct Record {
+        int64_t start;
+        int64_t end;
+        int32_t startDay;
+        int32_t lastDay;
+        uint32_t summary;
+        uint32_t description;
+        uint32_t organizer;
+        uint32_t creator;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    EventCache();
+    ~EventCache();
+
+    EventCache(const EventCache&) = delete;
+    EventCache& operator=(const EventCache&) = delete;
+
+    // Writes the events for month ("YYYY-MM") unless the partition already
+    // holds the same list, changed tells which of the two happened
+    static esp_err_t save(const EventList& events, const std::string& month, bool& changed);
+
+    // Maps the partition and validates it, false if it holds nothing usable
+    bool open();
+    void close();
+
+    size_t size() const;
+    const Record& record(size_t index) const;
+    const char* string(uint32_t offset) const;
+
+    // Fills in an event whose text points straight into the mapping, valid until close()
+    void read(size_t index, CalendarEvent& event) const;
+
+    // The same by value, so the cache can be drawn like an EventList
+    CalendarEvent operator[](size_t index) const;
+
+    std::string getMonth() const;
+    time_t getSavedAt() const;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t count;
+        uint32_t stringBytes;
+        uint32_t crc;        // Over the records and the string table
+        uint32_t savedAt;    // Epoch seconds
+        char month[8];       // "YYYY-MM"
+    };
+
+    const Header* header;
+    const Record* records;
+    const char* strings;
+    esp_partition_mmap_handle_t mapHandle;
+    bool mapped;
+
+    static const esp_partition_t* partition();
+};
+
+#endif // EVENT_CACHE_HPP
@@ -0,0 +1,20 @@
+#ifndef EVENT_TIME_HPP
+#define EVENT_TIME_HPP
+
+#include <cstdint>
+#include <ctime>
+
+// Calendar API timestamps turned into numbers once, when an event is
+// ingested, so rendering compares integers instead of re-parsing strings
+class EventTime {
+public:
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    static int32_t dayNumber(int year, int month, int day);
+
+    // Parses "YYYY-MM-DD" (local midnight) or an RFC 3339 dateTime such as
+    // "2024-10-05T17:00:00-07:00". day is the date as written, without any
+    // conversion, matching what the calendar shows for that event.
+    static bool parse(const char* text, time_t& epoch, int32_t& day);
+};
+
+#endif // EVENT_TIME_HPP
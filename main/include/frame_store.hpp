@@ -0,0 +1,43 @@
+#ifndef FRAME_STORE_HPP
+#define FRAME_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <esp_partition.h>
+#include "esp_err.h"
+
+#define FRAME_STORE_PARTITION "lastframe"
+
+// The framebuffer last shown on the panel, PackBits-compressed in a raw
+// flash partition. The panel holds its image through deep sleep, so once
+// this copy is restored as the high-level front buffer the next frame can be
+// diffed against what is really on screen instead of clearing it first.
+class FrameStore {
+public:
+    // partialRefreshes counts the diff-only refreshes since the last clean one
+    static esp_err_t save(const uint8_t* fb, size_t size, uint32_t partialRefreshes);
+
+    // Fills fb, false if nothing valid of this size is stored
+    static bool load(uint8_t* fb, size_t size, uint32_t& partialRefreshes);
+
+    // Called before the panel changes, a reset before the next save() must
+    // not leave behind a copy that no longer matches the screen
+    static void invalidate();
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        uint32_t rawSize;
+        uint32_t packedSize;
+        uint32_t crc;              // Over the packed data
+        uint32_t partialRefreshes;
+    };
+
+    static const esp_partition_t* partition();
+    static size_t pack(const uint8_t* in, size_t size, uint8_t* out);
+    static bool unpack(const uint8_t* in, size_t packedSize, uint8_t* out, size_t size);
+};
+
+#endif // FRAME_STORE_HPP
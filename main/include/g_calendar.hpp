@@ -1,19 +1,40 @@
 #ifndef G_CALENDAR_HPP
 #define G_CALENDAR_HPP
 
+#include <cstdint>
+#include <ctime>
 #include <string>
 #include <vector>
 #include "esp_err.h"
+#include "http_session.hpp"
+#include "wake_arena.hpp"
 
-// Structure to hold calendar event details
+// Structure to hold calendar event details. Text points into
+// StringPool::shared() and times are parsed at ingest, so an event is a
+// fixed-size value that copies without allocating.
 struct CalendarEvent {
-    std::string summary;
-    std::string description;
-    std::string creatorEmail;        // To store the creator's email
-    std::string organizerDisplayName; // To store the organizer's display name
-    std::string start;               // Can store either date or dateTime
-    std::string end;                 // Can store either date or dateTime
-    bool isAllDayEvent;              // Flag to indicate if it's an all-day event
+    const char* id = "";                   // Stable event ID, used to apply sync deltas
+    const char* summary = "";
+    const char* description = "";
+    const char* creatorEmail = "";         // To store the creator's email
+    const char* organizerDisplayName = ""; // To store the organizer's display name
+    time_t start = 0;                      // Epoch seconds, local midnight for all-day events
+    time_t end = 0;                        // Exclusive for all-day events
+    int32_t startDay = 0;                  // Civil day numbers (EventTime::dayNumber) of the
+    int32_t lastDay = 0;                   // first and last day the event is shown on
+    bool isAllDayEvent = false;            // Flag to indicate if it's an all-day event
+    bool isCancelled = false;              // Deleted upstream (only reported by incremental syncs)
+};
+
+// Event lists are built in the WakeArena and dropped with it before sleep
+using EventList = std::vector<CalendarEvent, ArenaAllocator<CalendarEvent>>;
+
+// One calendar's share of a fetch, filled in by a pool worker or a batch
+struct CalendarFetchJob {
+    std::string calendarId;
+    EventList events;
+    esp_err_t result;
+    bool unchanged;  // Server answered 304, events are the stored copy
 };
 
 // Class to manage Google Calendar API
@@ -21,22 +42,62 @@ class GoogleCalendar {
 public:
     GoogleCalendar(const std::string& clientId, const std::string& clientSecret, const std::string& refreshToken);
 
-    // Refreshes the access token using the refresh token
-    std::string refreshAccessToken();
+    // Refreshes the access token using the refresh token, expiresIn receives
+    // its lifetime in seconds (0 if the server did not say)
+    std::string refreshAccessToken(int& expiresIn);
+
+    // Brings the stored copy of a calendar up to date (incrementally when a
+    // sync token is available) and appends this month's events. unchanged is
+    // set when the server confirmed the stored copy with 304 Not Modified.
+    esp_err_t syncEvents(const std::string& accessToken, const std::string& calendarId, EventList& events,
+                         bool& unchanged);
+
+    // Syncs every job not yet ESP_OK with a single multipart/mixed request to
+    // the batch endpoint. Jobs whose part failed or that need more than one
+    // page keep their error and are left to syncEvents.
+    esp_err_t syncEventsBatch(const std::string& accessToken, std::vector<CalendarFetchJob>& jobs);
+
+    // This month's events from the last successful sync of a calendar, for
+    // when it cannot be reached. False if nothing usable is stored.
+    static bool loadStoredEvents(const std::string& calendarId, EventList& events);
 
-    // Fetches events for the current month
-    esp_err_t getEvents(const std::string& accessToken, const std::string& calendarId, std::vector<CalendarEvent>& events);
+    // Requests, bytes and parse time of every instance since boot
+    static void logStats();
 
 private:
     std::string clientId;
     std::string clientSecret;
     std::string refreshToken;
 
-    // Parses the JSON response and extracts events
-    void parseEvents(const std::string& payload, std::vector<CalendarEvent>& eventsVector);
+    // Kept open for the lifetime of the object so every calendar and every
+    // page reuses one TCP + TLS connection per host
+    HttpSession apiSession;
+    HttpSession oauthSession;
+
+    // Buffered (non-streamed) response bodies, reused by every request of this object
+    ResponseArena responseArena;
+
+    // Requests every page of an events query, streaming each page through the parser.
+    // A non-empty etag is sent as If-None-Match and replaced by the response's
+    // ETag, which is only kept for single page results.
+    esp_err_t fetchEventPages(const std::string& accessToken, const std::string& calendarId, const std::string& query,
+                              EventList& events, std::string& nextSyncToken,
+                              std::string& etag, bool& notModified);
+
+    // Path and query of an events list request, without the host
+    std::string eventsPath(const std::string& calendarId, const std::string& query);
+
+    // Merges an incremental sync result into the stored events
+    void applyDeltas(EventList& stored, EventList& deltas);
 
     // Creates a time range for this month's events
     std::string createTimeRange();
+
+    // "YYYY-MM" of the current month, used to invalidate stored sync state
+    static std::string currentMonth();
+
+    // Percent-encodes a query parameter value
+    static std::string urlEncode(const std::string& value);
 };
 
 #endif // GCALENDAR_HPP
@@ -0,0 +1,97 @@
+#ifndef G_CALENDAR_PARSER_HPP
+#define G_CALENDAR_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "g_calendar.hpp"
+
+#define PARSER_MAX_DEPTH      8    // Deeper containers are skipped, not tracked
+#define PARSER_MAX_KEY_LEN    23   // Longest key we ever match is well below this
+#define PARSER_MAX_FIELD_LEN  512  // Longer string values are truncated
+
+// Incremental (SAX-style) parser for the Calendar API events list.
+// Response bytes are fed as they arrive and a CalendarEvent is handed to the
+// sink every time an element of "items" closes, so peak memory is bounded by
+// one event instead of the whole response. Its text is moved into the
+// StringPool and its times are parsed before it is emitted.
+class CalendarEventParser {
+public:
+    using EventSink = std::function<void(CalendarEvent&)>;
+
+    explicit CalendarEventParser(EventSink sink);
+
+    // Prepares the parser for a new response body
+    void reset();
+
+    // Consumes the next chunk of the response body
+    void feed(const char* data, size_t len);
+
+    // True once the root object has been closed
+    bool isComplete() const { return complete; }
+    bool hasError() const { return error; }
+    size_t eventCount() const { return emitted; }
+
+    // Token for the following page, empty on the last page
+    const std::string& nextPageToken() const { return pageToken; }
+
+    // Token for the next incremental sync, only present on the last page
+    const std::string& nextSyncToken() const { return syncToken; }
+
+private:
+    enum class Container : uint8_t {
+        Object,
+        Array
+    };
+
+    struct Frame {
+        Container type;
+        char key[PARSER_MAX_KEY_LEN + 1]; // Last key read inside this object
+    };
+
+    EventSink sink;
+
+    Frame stack[PARSER_MAX_DEPTH];
+    int depth;           // Number of open containers, may exceed PARSER_MAX_DEPTH
+    bool expectKey;      // Next string inside the current object is a key
+    bool inString;
+    bool stringIsKey;
+    bool escape;
+    int unicodeDigits;   // Remaining hex digits of a \uXXXX escape
+    uint32_t unicodeValue;
+    uint32_t highSurrogate;
+    size_t keyLen;
+    std::string* target; // Destination of the current string value, if any
+
+    // Raw text of the event being read, reused so parsing does not allocate per event
+    struct Fields {
+        std::string id;
+        std::string summary;
+        std::string description;
+        std::string creatorEmail;
+        std::string organizerDisplayName;
+        std::string start;
+        std::string end;
+        std::string status;
+    } fields;
+    std::string pageToken;
+    std::string syncToken;
+    bool hasStartDate;
+    bool complete;
+    bool error;
+    size_t emitted;
+
+    void openContainer(Container type);
+    void closeContainer(Container type);
+    void beginString();
+    void endString();
+    void appendChar(char c);
+    void appendCodepoint(uint32_t cp);
+    std::string* selectTarget();
+    bool inItemsElement() const;
+    void resetEvent();
+    void emitEvent();
+};
+
+#endif // G_CALENDAR_PARSER_HPP
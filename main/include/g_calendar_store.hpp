@@ -0,0 +1,47 @@
+#ifndef G_CALENDAR_STORE_HPP
+#define G_CALENDAR_STORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nvs.h>
+#include "esp_err.h"
+#include "g_calendar.hpp"
+
+#define CALENDAR_STORE_PARTITION "calstore"
+
+// Per-calendar event store kept in its own NVS partition so it survives
+// deep sleep. Holds the last nextSyncToken, the month it belongs to, the
+// events they describe and, when the server handed back the token it was
+// sent, the ETag of that response. The ETag then answers exactly the query
+// the next wake sends, letting it fetch only the deltas or nothing at all.
+class CalendarEventStore {
+public:
+    // Mounts the store partition, erasing it only when NVS cannot mount it
+    // (no free pages or a newer NVS format). Events stored in another
+    // STORE_VERSION layout just fail to load(), so that calendar is fully
+    // synced once and its next save() replaces them.
+    static esp_err_t init();
+
+    explicit CalendarEventStore(const std::string& calendarId);
+
+    bool load(std::string& syncToken, std::string& month, std::string& etag, EventList& events);
+    // Fails with ESP_ERR_NVS_NOT_ENOUGH_SPACE, leaving nothing stored for this
+    // calendar, if the events do not fit into the partition
+    esp_err_t save(const std::string& syncToken, const std::string& month, const std::string& etag,
+                   const EventList& events);
+    esp_err_t clear();
+
+private:
+    // NVS keys are limited to 15 characters, so they are derived from a hash of the ID
+    std::string tokenKey;
+    std::string monthKey;
+    std::string eventsKey;
+    std::string etagKey;
+
+    void eraseKeys(nvs_handle_t handle);
+    static void serialize(const EventList& events, std::vector<uint8_t>& out);
+    static bool deserialize(const std::vector<uint8_t>& in, EventList& events);
+};
+
+#endif // G_CALENDAR_STORE_HPP
@@ -0,0 +1,58 @@
+#ifndef GZIP_INFLATER_HPP
+#define GZIP_INFLATER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Incremental gzip decoder sitting between the HTTP data callback and the
+// JSON parser. Inflated bytes are handed to the sink as soon as they are
+// produced through a fixed 32 KB window (the deflate maximum), so the body
+// is never held in RAM as a whole.
+class GzipInflater {
+public:
+    using Sink = std::function<void(const char* data, size_t len)>;
+
+    explicit GzipInflater(Sink sink);
+    ~GzipInflater();
+
+    GzipInflater(const GzipInflater&) = delete;
+    GzipInflater& operator=(const GzipInflater&) = delete;
+
+    // Prepares for a new gzip member, allocating the window on first use
+    bool reset();
+
+    // Consumes compressed bytes, returns false on a corrupt stream
+    bool feed(const char* data, size_t len);
+
+    bool isDone() const { return state == State::Done; }
+    size_t getInflatedBytes() const { return inflatedBytes; }
+
+private:
+    enum class State : uint8_t {
+        Header,    // Fixed 10 byte header
+        ExtraLen,  // FEXTRA length
+        Extra,     // FEXTRA payload
+        Name,      // FNAME, zero terminated
+        Comment,   // FCOMMENT, zero terminated
+        HeaderCrc, // FHCRC
+        Deflate,
+        Done,      // Trailer and anything after it is ignored
+        Error
+    };
+
+    Sink sink;
+    State state;
+    uint8_t flags;
+    size_t fieldPos;      // Bytes consumed of the current header field
+    size_t extraLen;
+    size_t windowPos;     // Next write position in the circular window
+    size_t inflatedBytes;
+    void* decompressor;   // tinfl_decompressor
+    uint8_t* window;
+
+    void nextHeaderField();
+    bool inflate(const uint8_t* data, size_t len);
+};
+
+#endif // GZIP_INFLATER_HPP
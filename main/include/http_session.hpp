@@ -0,0 +1,64 @@
+#ifndef HTTP_SESSION_HPP
+#define HTTP_SESSION_HPP
+
+#include <functional>
+#include <string>
+#include <esp_http_client.h>
+#include "gzip_inflater.hpp"
+#include "response_arena.hpp"
+
+// Per-request state handed to the event handler through user_data, so
+// concurrent requests never share buffers and a failed request cannot leave
+// anything behind for the next one
+struct HttpRequestContext {
+    using StreamSink = std::function<void(const char* data, size_t len)>;
+
+    ResponseArena* body = nullptr; // Optional, receives the body NUL-terminated
+    bool overflow = false;     // Body did not fit into the arena
+    StreamSink sink;           // Optional, fed every chunk of a 200 OK body instead of the arena
+    size_t bytesReceived = 0;  // Body bytes seen, buffered or not
+    GzipInflater* inflater = nullptr; // Optional, decodes a gzip 200 OK body before the sink
+    bool gzipEncoded = false;  // Response carried Content-Encoding: gzip
+    bool decodeError = false;  // Inflater rejected the body
+    std::string etag;          // ETag response header, empty if none was sent
+    std::string contentType;   // Content-Type response header
+
+    void reset();
+};
+
+// Keeps a single esp_http_client (and its TCP + TLS connection) open across
+// requests to the same host. Each request brings its own HttpRequestContext.
+class HttpSession {
+public:
+    HttpSession(const char* url, const char* certPem, size_t certLen);
+    ~HttpSession();
+
+    HttpSession(const HttpSession&) = delete;
+    HttpSession& operator=(const HttpSession&) = delete;
+
+    // Sends a request over the shared connection, opening it on first use
+    esp_err_t perform(esp_http_client_method_t method, const std::string& url,
+                      HttpRequestContext& context, const std::string& postData = std::string());
+
+    void setHeader(const char* key, const std::string& value);
+    void deleteHeader(const char* key);
+
+    int getStatusCode();
+    int getRequestCount() const { return requestCount; }
+
+    // Drops the connection, the next perform() reconnects
+    void close();
+
+private:
+    const char* url;
+    const char* certPem;
+    size_t certLen;
+    esp_http_client_handle_t client;
+    esp_transport_handle_t transport; // Session-resuming TLS, owned by us
+    int requestCount;
+
+    bool open();
+    static esp_err_t eventHandler(esp_http_client_event_t* evt);
+};
+
+#endif // HTTP_SESSION_HPP
@@ -19,13 +19,14 @@ public:
     void initializeSNTP();
     void getCurrentTimeInfo(struct tm& timeinfo);
     std::string obtainTime();
+    bool restoreClock();
     int getFirstDayOfMonth();
     int getLastDayOfMonth();
     std::string getCurrentMonthYear();
     int getTodayDay();
     std::string getTodayDate();
     std::pair<std::string, std::string> getStartAndEndDates();
-    std::string formatRangeToCustomDate(const std::string& start, const std::string& end, bool isAllDayEvent);
+    std::string formatRangeToCustomDate(time_t start, time_t end, bool isAllDayEvent);
     int scheduleHibernationUntilMidnight30();
     
 private:
@@ -34,8 +35,6 @@ private:
     EventBits_t connected_bit;
     static void timeSyncNotificationCb(struct timeval* tv);
     static LocalTime* instance;
-    std::string preprocessTimestamp(const std::string& input);
-    bool isDateOnly(const std::string& input);
 };
 
 #endif // LOCALTIME_HPP
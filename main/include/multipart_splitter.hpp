@@ -0,0 +1,71 @@
+#ifndef MULTIPART_SPLITTER_HPP
+#define MULTIPART_SPLITTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#define MULTIPART_MAX_LINE_LEN 256 // Longer header lines are truncated
+
+// Incremental splitter for a multipart/mixed batch response whose parts are
+// embedded HTTP responses (Content-Type: application/http). Bytes are fed as
+// they arrive, each part's body is passed on as it is found, so no part is
+// ever held in RAM as a whole.
+class MultipartSplitter {
+public:
+    struct Part {
+        std::string contentId;   // Content-ID header of the part
+        int statusCode;          // From the embedded HTTP status line
+        std::string etag;        // ETag header of the embedded response
+    };
+
+    using PartSink = std::function<void(const Part& part)>;
+    using DataSink = std::function<void(const Part& part, const char* data, size_t len)>;
+
+    // begin fires once a part's headers are read, end once its body is complete
+    MultipartSplitter(PartSink begin, DataSink data, PartSink end);
+
+    // Prepares for a new body delimited by boundary
+    void reset(const std::string& boundary);
+
+    // Consumes the next chunk of the multipart body
+    void feed(const char* data, size_t len);
+
+    // True once the closing delimiter has been seen
+    bool isComplete() const { return state == State::Done; }
+    int partCount() const { return parts; }
+
+    // Extracts the boundary parameter of a multipart Content-Type, empty if none
+    static std::string boundaryFrom(const std::string& contentType);
+
+private:
+    enum class State : uint8_t {
+        Preamble,     // Before the first delimiter
+        AfterBoundary,// Rest of a delimiter line, "--" closes the body
+        PartHeaders,  // MIME headers of the part
+        StatusLine,   // Embedded "HTTP/1.1 200 OK"
+        HttpHeaders,  // Headers of the embedded response
+        Body,
+        Done
+    };
+
+    PartSink beginSink;
+    DataSink dataSink;
+    PartSink endSink;
+
+    State state;
+    std::string delimiter;   // "\r\n--" + boundary
+    size_t matched;          // Delimiter bytes matched so far
+    size_t heldFrom;         // 2 if the match began without the CRLF, which was never read
+    bool bareStart;          // At the start of the preamble or a body, "--" + boundary alone counts
+    std::string line;
+    Part part;
+    int parts;
+
+    void flushHeld();
+    void onLine();
+    void onDelimiter();
+};
+
+#endif // MULTIPART_SPLITTER_HPP
@@ -0,0 +1,39 @@
+#ifndef RESPONSE_ARENA_HPP
+#define RESPONSE_ARENA_HPP
+
+#include <cstddef>
+
+// Growable response body buffer in PSRAM. Grows in RESPONSE_ARENA_CHUNK
+// steps up to RESPONSE_ARENA_MAX and keeps its memory between requests, so
+// one wake allocates it once instead of putting bodies on the task stack.
+class ResponseArena {
+public:
+    ResponseArena();
+    ~ResponseArena();
+
+    ResponseArena(const ResponseArena&) = delete;
+    ResponseArena& operator=(const ResponseArena&) = delete;
+
+    // Forgets the contents, keeps the memory for the next request
+    void clear();
+
+    // Appends and NUL-terminates, returns false if the body had to be truncated
+    bool append(const char* data, size_t len);
+
+    const char* c_str() const { return data ? data : ""; }
+    size_t size() const { return length; }
+    size_t getCapacity() const { return capacity; }
+
+    // Largest body held by any arena since power-on
+    static size_t getHighWaterMark();
+    static void logStats();
+
+private:
+    char* data;
+    size_t length;
+    size_t capacity;
+
+    bool grow(size_t needed);
+};
+
+#endif // RESPONSE_ARENA_HPP
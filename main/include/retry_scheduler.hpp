@@ -0,0 +1,36 @@
+#ifndef RETRY_SCHEDULER_HPP
+#define RETRY_SCHEDULER_HPP
+
+#include <cstdint>
+
+// Exponential backoff with jitter. Used for fetch retries within one wake
+// and for the timed deep-sleep schedule after wakes that fetched nothing,
+// so a flaky access point never leads to a reboot loop or endless sleep.
+class RetryScheduler {
+public:
+    RetryScheduler(uint32_t baseMs, uint32_t maxMs, int maxAttempts);
+
+    // Blocks for the next backoff delay, false once every attempt is used up
+    bool waitBeforeRetry();
+
+    int getAttempt() const { return attempt; }
+
+    // Random delay in [d/2, d) where d = base * 2^attempt, capped at max
+    static uint32_t backoff(uint32_t base, uint32_t max, int attempt);
+
+    // Seconds to sleep after this many consecutive failed wakes, never more
+    // than untilRefresh so the daily refresh is not skipped
+    static uint32_t sleepAfterFailures(int failures, uint32_t untilRefresh);
+
+    // Seconds to sleep after drawing at this panel temperature. Outside the
+    // range the waveforms are made for, the picture is redrawn sooner.
+    static uint32_t sleepForTemperature(int celsius, uint32_t untilRefresh);
+
+private:
+    uint32_t baseMs;
+    uint32_t maxMs;
+    int maxAttempts;
+    int attempt;
+};
+
+#endif // RETRY_SCHEDULER_HPP
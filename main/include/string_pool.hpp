@@ -0,0 +1,53 @@
+#ifndef STRING_POOL_HPP
+#define STRING_POOL_HPP
+
+#include <cstddef>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Append-only store for event text. Strings and the lookup table live in the
+// WakeArena and are dropped with it at the end of the cycle, so events hold
+// plain pointers and copying one allocates nothing. intern() returns the
+// same pointer for equal strings, which collapses the organizer, creator and
+// recurring summaries of a month into one copy each.
+class StringPool {
+public:
+    // The pool every event of this wake points into
+    static StringPool& shared();
+
+    StringPool();
+    ~StringPool();
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    // NUL-terminated copy shared with every equal string
+    const char* intern(const char* str, size_t len);
+    const char* intern(const std::string& str) { return intern(str.data(), str.size()); }
+
+    // NUL-terminated copy without the lookup, for strings that never repeat
+    const char* store(const char* str, size_t len);
+    const char* store(const std::string& str) { return store(str.data(), str.size()); }
+
+    // Forgets every string, call right before WakeArena::reset()
+    void reset();
+
+    void logStats();
+
+private:
+    const char** slots;   // Open addressing table of interned strings
+    size_t slotCount;
+    size_t slotsUsed;
+    SemaphoreHandle_t lock;  // Fetch workers parse concurrently
+
+    size_t stringCount;
+    size_t bytesStored;
+    size_t bytesShared;   // Saved by returning an existing copy
+
+    char* copy(const char* str, size_t len);
+    void growTable();
+    static uint32_t hash(const char* str, size_t len);
+};
+
+#endif // STRING_POOL_HPP
@@ -0,0 +1,25 @@
+#ifndef TLS_RESUME_TRANSPORT_HPP
+#define TLS_RESUME_TRANSPORT_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_transport.h>
+
+#define TLS_SESSION_CACHE_SLOTS 2     // One per host we talk to
+#define TLS_SESSION_MAX_LEN     1024  // Serialized session incl. ticket, the peer certificate is kept as a digest
+
+// TLS transport for esp_http_client that offers the session saved by the
+// previous connection to the same host. Sessions are serialized into RTC
+// memory, so the first handshake after deep sleep can be abbreviated.
+class TlsResumeTransport {
+public:
+    // Creates a transport owned by the caller, release with esp_transport_destroy()
+    static esp_transport_handle_t create(const char* certPem, size_t certLen);
+
+    // Full and abbreviated handshakes since power-on
+    static uint32_t getHandshakeCount();
+    static uint32_t getResumedCount();
+    static void logStats();
+};
+
+#endif // TLS_RESUME_TRANSPORT_HPP
@@ -0,0 +1,80 @@
+#ifndef WAKE_ARENA_HPP
+#define WAKE_ARENA_HPP
+
+#include <cstddef>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Bump allocator in PSRAM for everything one refresh cycle builds: event
+// lists, interned text and layout scratch. Blocks of WAKE_ARENA_BLOCK bytes
+// are chained as needed and all of it goes away in a single reset(), so
+// parsing and drawing leave no fragmented heap behind.
+class WakeArena {
+public:
+    static WakeArena& shared();
+
+    WakeArena();
+    ~WakeArena();
+
+    WakeArena(const WakeArena&) = delete;
+    WakeArena& operator=(const WakeArena&) = delete;
+
+    // Never returns null, running out of PSRAM aborts like a failed new
+    void* allocate(size_t size, size_t align);
+
+    // Takes the memory back only if it was the latest allocation, such as
+    // scratch freed right after use. Anything else waits for reset().
+    void release(void* ptr, size_t size);
+
+    // NUL-terminated copy
+    char* copy(const char* str, size_t len);
+
+    // Frees everything allocated since the last reset, keeping the first block
+    void reset();
+
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    void logStats();
+
+    // Free bytes and fragmentation of internal RAM and PSRAM
+    static void logHeap(const char* when);
+
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+        size_t used;
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+    };
+
+    Block* blocks;          // Newest first
+    size_t used;            // Bytes handed out, including alignment padding
+    size_t peak;
+    size_t capacity;
+    int blockCount;
+    SemaphoreHandle_t lock; // Fetch workers allocate concurrently
+};
+
+// Standard allocator on top of WakeArena::shared()
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(WakeArena::shared().allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t n) {
+        WakeArena::shared().release(ptr, n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return false; }
+
+#endif // WAKE_ARENA_HPP
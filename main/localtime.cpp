@@ -53,6 +53,19 @@ std::string LocalTime::obtainTime() {
     return std::string(strftime_buf);
 }
 
+// Applies the time zone to the clock the RTC kept, false if it was never set
+bool LocalTime::restoreClock() {
+    setenv("TZ", timezone, 1);
+    tzset();
+
+    time_t now = time(nullptr);
+    if (now < 1577836800) { // Before 2020
+        ESP_LOGI(TAG, "RTC clock not set yet");
+        return false;
+    }
+    return true;
+}
+
 int LocalTime::getFirstDayOfMonth() {
     struct tm timeinfo = {};
     getCurrentTimeInfo(timeinfo);
@@ -158,65 +171,15 @@ std::pair<std::string, std::string> LocalTime::getStartAndEndDates() {
 }
 
 
-std::string LocalTime::preprocessTimestamp(const std::string& input) {
-    std::string result = input;
-    // Remove the colon in the timezone offset
-    size_t pos = result.find_last_of(':');
-    if (pos != std::string::npos && pos > result.find('T')) {
-        result.erase(pos, 1); // Remove the colon
-    }
-    return result;
-}
-
-bool LocalTime::isDateOnly(const std::string& input) {
-    // Check if the string contains a 'T' (indicates full timestamp)
-    return input.find('T') == std::string::npos;
-}
-
-std::string LocalTime::formatRangeToCustomDate(const std::string& start, const std::string& end, bool isAllDayEvent) {
+std::string LocalTime::formatRangeToCustomDate(time_t start, time_t end, bool isAllDayEvent) {
     struct tm startTimeinfo = {}, endTimeinfo = {};
     char formattedStart[64], formattedEnd[64];
 
-    // Helper to preprocess the timezone format
-    auto preprocessTimestamp = [](const std::string& timestamp) -> std::string {
-        std::string result = timestamp;
-        size_t pos = result.find_last_of(':');
-        if (pos != std::string::npos && pos > result.size() - 6) {
-            // Convert -08:00 to -0800
-            result.erase(pos, 1);
-        }
-        return result;
-    };
-
-    // Preprocess timestamps to handle timezone offsets
-    std::string processedStart = preprocessTimestamp(start);
-    std::string processedEnd = preprocessTimestamp(end);
-
-    // Parse start time
-    if (processedStart.find('T') == std::string::npos) {  // Date only
-        if (strptime(processedStart.c_str(), "%Y-%m-%d", &startTimeinfo) == nullptr) {
-            return "Invalid start date format";
-        }
-    } else {  // Full timestamp
-        if (strptime(processedStart.c_str(), "%Y-%m-%dT%H:%M:%S", &startTimeinfo) == nullptr) {
-            return "Invalid start timestamp format";
-        }
-    }
-
-    // Parse end time
-    if (processedEnd.find('T') == std::string::npos) {  // Date only
-        if (strptime(processedEnd.c_str(), "%Y-%m-%d", &endTimeinfo) == nullptr) {
-            return "Invalid end date format";
-        }
-    } else {  // Full timestamp
-        if (strptime(processedEnd.c_str(), "%Y-%m-%dT%H:%M:%S", &endTimeinfo) == nullptr) {
-            return "Invalid end timestamp format";
-        }
-    }
+    localtime_r(&start, &startTimeinfo);
 
     // Adjust for all-day events
     if (isAllDayEvent) {
-        time_t endTime = mktime(&endTimeinfo) - 86400;  // Subtract 24 hours
+        time_t endTime = end - 86400;  // The end date is exclusive
         localtime_r(&endTime, &endTimeinfo);
         if (startTimeinfo.tm_year == endTimeinfo.tm_year &&
             startTimeinfo.tm_mon == endTimeinfo.tm_mon &&
@@ -229,6 +192,7 @@ std::string LocalTime::formatRangeToCustomDate(const std::string& start, const s
         return std::string(formattedStart) + " to " + std::string(formattedEnd);
     } else {
         // Format for non-all-day events
+        localtime_r(&end, &endTimeinfo);
         strftime(formattedStart, sizeof(formattedStart), "%b %d, %Y %I:%M %p", &startTimeinfo);
         strftime(formattedEnd, sizeof(formattedEnd), "%b %d, %Y %I:%M %p", &endTimeinfo);
 
@@ -0,0 +1,172 @@
+#include "multipart_splitter.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+MultipartSplitter::MultipartSplitter(PartSink begin, DataSink data, PartSink end)
+    : beginSink(begin), dataSink(data), endSink(end) {
+    reset(std::string());
+}
+
+void MultipartSplitter::reset(const std::string& boundary) {
+    state = State::Preamble;
+    delimiter = "\r\n--" + boundary;
+    matched = 0;
+    heldFrom = 0;
+    // The first delimiter may open the body without a preceding CRLF
+    bareStart = true;
+    line.clear();
+    part = Part();
+    part.statusCode = 0;
+    parts = 0;
+}
+
+std::string MultipartSplitter::boundaryFrom(const std::string& contentType) {
+    size_t pos = 0;
+    while ((pos = contentType.find('=', pos)) != std::string::npos) {
+        if (pos >= 8 && strncasecmp(contentType.c_str() + pos - 8, "boundary", 8) == 0) {
+            size_t start = pos + 1;
+            size_t end = contentType.find(';', start);
+            std::string boundary = contentType.substr(start, end == std::string::npos ? std::string::npos : end - start);
+            if (boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"') {
+                boundary = boundary.substr(1, boundary.size() - 2);
+            }
+            return boundary;
+        }
+        pos++;
+    }
+    return std::string();
+}
+
+// Bytes held back as a possible delimiter turned out to be body. A match
+// that began without the CRLF only holds the bytes from heldFrom on.
+void MultipartSplitter::flushHeld() {
+    if (state == State::Body && matched > heldFrom) {
+        dataSink(part, delimiter.data() + heldFrom, matched - heldFrom);
+    }
+}
+
+void MultipartSplitter::onDelimiter() {
+    if (state == State::Body) {
+        endSink(part);
+    }
+    state = State::AfterBoundary;
+    line.clear();
+}
+
+// Returns true and the trimmed value if line is the header name
+static bool headerValue(const std::string& line, const char* name, std::string& value) {
+    size_t nameLen = strlen(name);
+    if (line.size() <= nameLen || line[nameLen] != ':' || strncasecmp(line.c_str(), name, nameLen) != 0) {
+        return false;
+    }
+    size_t start = line.find_first_not_of(" \t", nameLen + 1);
+    value = start == std::string::npos ? std::string() : line.substr(start);
+    return true;
+}
+
+void MultipartSplitter::onLine() {
+    switch (state) {
+        case State::AfterBoundary:
+            // Transport padding after the delimiter is allowed
+            state = State::PartHeaders;
+            part = Part();
+            part.statusCode = 0;
+            break;
+        case State::PartHeaders:
+            if (line.empty()) {
+                state = State::StatusLine;
+            } else {
+                headerValue(line, "Content-ID", part.contentId);
+            }
+            break;
+        case State::StatusLine:
+            if (!line.empty()) {
+                size_t space = line.find(' ');
+                part.statusCode = space == std::string::npos ? 0 : atoi(line.c_str() + space + 1);
+                state = State::HttpHeaders;
+            }
+            break;
+        case State::HttpHeaders:
+            if (line.empty()) {
+                parts++;
+                beginSink(part);
+                state = State::Body;
+                // Tolerate an empty body followed by a delimiter without its CRLF
+                bareStart = true;
+            } else {
+                headerValue(line, "ETag", part.etag);
+            }
+            break;
+        default:
+            break;
+    }
+    line.clear();
+}
+
+void MultipartSplitter::feed(const char* data, size_t len) {
+    size_t runStart = 0;
+    size_t runLen = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+
+        if (state == State::Done) {
+            break; // Epilogue
+        }
+
+        if (state == State::Preamble || state == State::Body) {
+            bool bare = bareStart && matched == 0 && c == delimiter[2];
+            bareStart = false;
+            if (c == delimiter[matched] || bare) {
+                // Pass on the body read so far before holding bytes back
+                if (runLen > 0) {
+                    if (state == State::Body) dataSink(part, data + runStart, runLen);
+                    runLen = 0;
+                }
+                if (matched == 0) {
+                    heldFrom = bare ? 2 : 0;
+                    matched = heldFrom;
+                }
+                if (++matched == delimiter.size()) {
+                    matched = 0;
+                    onDelimiter();
+                }
+                continue;
+            }
+            if (matched > 0) {
+                flushHeld();
+                matched = 0;
+                // '\r' only appears at the start of the delimiter, so this is the only restart point
+                if (c == delimiter[0]) {
+                    matched = 1;
+                    heldFrom = 0;
+                    continue;
+                }
+            }
+            if (runLen == 0) {
+                runStart = i;
+            }
+            runLen++;
+            continue;
+        }
+
+        // Header lines
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            onLine();
+        } else if (line.size() < MULTIPART_MAX_LINE_LEN) {
+            line.push_back(c);
+            // The closing delimiter may not be followed by a line break
+            if (state == State::AfterBoundary && line == "--") {
+                state = State::Done;
+            }
+        }
+    }
+
+    if (runLen > 0 && state == State::Body) {
+        dataSink(part, data + runStart, runLen);
+    }
+}
@@ -0,0 +1,95 @@
+#include "response_arena.hpp"
+#include <cstring>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "app_config.hpp"
+
+static const char* TAG = "[Response Arena]";
+
+// Arenas are used from several fetch workers at once
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static size_t highWaterMark = 0;
+static size_t peakCapacity = 0;
+
+ResponseArena::ResponseArena() : data(nullptr), length(0), capacity(0) {}
+
+ResponseArena::~ResponseArena() {
+    heap_caps_free(data);
+}
+
+void ResponseArena::clear() {
+    length = 0;
+    if (data) {
+        data[0] = '\0';
+    }
+}
+
+bool ResponseArena::grow(size_t needed) {
+    size_t newCapacity = capacity;
+    while (newCapacity < needed) {
+        newCapacity += RESPONSE_ARENA_CHUNK;
+    }
+    if (newCapacity > RESPONSE_ARENA_MAX) {
+        newCapacity = RESPONSE_ARENA_MAX;
+    }
+    if (newCapacity <= capacity) {
+        return false;
+    }
+
+    char* grown = static_cast<char*>(heap_caps_realloc(data, newCapacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+    if (!grown) {
+        ESP_LOGE(TAG, "Failed to grow to %d bytes", (int)newCapacity);
+        return false;
+    }
+    data = grown;
+    capacity = newCapacity;
+
+    portENTER_CRITICAL(&statsLock);
+    if (capacity > peakCapacity) {
+        peakCapacity = capacity;
+    }
+    portEXIT_CRITICAL(&statsLock);
+
+    // Clamped to RESPONSE_ARENA_MAX, the caller truncates to what fits
+    return capacity >= needed;
+}
+
+bool ResponseArena::append(const char* bytes, size_t len) {
+    bool complete = true;
+    if (length + len + 1 > capacity && !grow(length + len + 1)) {
+        // Keep what fits, the caller sees the truncation
+        complete = false;
+        len = capacity > length + 1 ? capacity - length - 1 : 0;
+    }
+    if (len > 0) {
+        memcpy(data + length, bytes, len);
+        length += len;
+    }
+    if (data) {
+        data[length] = '\0';
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    if (length > highWaterMark) {
+        highWaterMark = length;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    return complete;
+}
+
+size_t ResponseArena::getHighWaterMark() {
+    portENTER_CRITICAL(&statsLock);
+    size_t mark = highWaterMark;
+    portEXIT_CRITICAL(&statsLock);
+    return mark;
+}
+
+void ResponseArena::logStats() {
+    portENTER_CRITICAL(&statsLock);
+    size_t mark = highWaterMark;
+    size_t peak = peakCapacity;
+    portEXIT_CRITICAL(&statsLock);
+    ESP_LOGI(TAG, "Largest buffered body %d bytes, largest arena %d of %d bytes",
+             (int)mark, (int)peak, RESPONSE_ARENA_MAX);
+}
@@ -0,0 +1,55 @@
+#include "retry_scheduler.hpp"
+#include <esp_log.h>
+#include <esp_random.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "app_config.hpp"
+
+static const char* TAG = "[Retry]";
+
+RetryScheduler::RetryScheduler(uint32_t baseMs, uint32_t maxMs, int maxAttempts)
+    : baseMs(baseMs), maxMs(maxMs), maxAttempts(maxAttempts), attempt(0) {}
+
+bool RetryScheduler::waitBeforeRetry() {
+    if (attempt >= maxAttempts) {
+        return false;
+    }
+    uint32_t delayMs = backoff(baseMs, maxMs, attempt);
+    attempt++;
+    ESP_LOGI(TAG, "Retry %d of %d in %d ms", attempt, maxAttempts, (int)delayMs);
+    vTaskDelay(pdMS_TO_TICKS(delayMs));
+    return true;
+}
+
+uint32_t RetryScheduler::backoff(uint32_t base, uint32_t max, int attempt) {
+    uint32_t delay = base;
+    for (int i = 0; i < attempt && delay < max; i++) {
+        delay *= 2;
+    }
+    if (delay > max) {
+        delay = max;
+    }
+
+    // Half fixed, half random, so devices behind the same AP drift apart
+    uint32_t half = delay / 2;
+    return half + (half ? esp_random() % half : 0);
+}
+
+uint32_t RetryScheduler::sleepAfterFailures(int failures, uint32_t untilRefresh) {
+    uint32_t seconds = backoff(RETRY_SLEEP_BASE_S, RETRY_SLEEP_MAX_S, failures > 0 ? failures - 1 : 0);
+    if (seconds > untilRefresh) {
+        seconds = untilRefresh;
+    }
+    ESP_LOGI(TAG, "%d failed wakes, next attempt in %d s", failures, (int)seconds);
+    return seconds;
+}
+
+uint32_t RetryScheduler::sleepForTemperature(int celsius, uint32_t untilRefresh) {
+    if (celsius >= PANEL_MIN_TEMP_C && celsius <= PANEL_MAX_TEMP_C) {
+        return untilRefresh;
+    }
+    uint32_t seconds = TEMPERATURE_RETRY_S < untilRefresh ? TEMPERATURE_RETRY_S : untilRefresh;
+    ESP_LOGW(TAG, "Panel at %d C, outside %d..%d C, redrawing in %d s", celsius, PANEL_MIN_TEMP_C, PANEL_MAX_TEMP_C,
+             (int)seconds);
+    return seconds;
+}
@@ -0,0 +1,115 @@
+#include "string_pool.hpp"
+#include <cstring>
+#include "esp_log.h"
+#include "wake_arena.hpp"
+
+static const char* TAG = "[String Pool]";
+
+#define INITIAL_SLOTS 256
+
+StringPool& StringPool::shared() {
+    static StringPool pool;
+    return pool;
+}
+
+StringPool::StringPool()
+    : slots(nullptr), slotCount(0), slotsUsed(0), lock(xSemaphoreCreateMutex()),
+      stringCount(0), bytesStored(0), bytesShared(0) {}
+
+StringPool::~StringPool() {
+    vSemaphoreDelete(lock);
+}
+
+// FNV-1a
+uint32_t StringPool::hash(const char* str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+char* StringPool::copy(const char* str, size_t len) {
+    stringCount++;
+    bytesStored += len + 1;
+    return WakeArena::shared().copy(str, len);
+}
+
+void StringPool::growTable() {
+    size_t newCount = slotCount ? slotCount * 2 : INITIAL_SLOTS;
+    const char** grown = static_cast<const char**>(
+        WakeArena::shared().allocate(newCount * sizeof(const char*), alignof(const char*)));
+    memset(grown, 0, newCount * sizeof(const char*));
+    for (size_t i = 0; i < slotCount; i++) {
+        if (slots[i]) {
+            size_t pos = hash(slots[i], strlen(slots[i])) & (newCount - 1);
+            while (grown[pos]) {
+                pos = (pos + 1) & (newCount - 1);
+            }
+            grown[pos] = slots[i];
+        }
+    }
+    WakeArena::shared().release(slots, slotCount * sizeof(const char*));
+    slots = grown;
+    slotCount = newCount;
+}
+
+const char* StringPool::intern(const char* str, size_t len) {
+    if (len == 0) {
+        return "";
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const char* result = nullptr;
+
+    // Keep the load factor under 3/4
+    if ((slotsUsed + 1) * 4 > slotCount * 3) {
+        growTable();
+    }
+    size_t pos = hash(str, len) & (slotCount - 1);
+    while (slots[pos]) {
+        if (strncmp(slots[pos], str, len) == 0 && slots[pos][len] == '\0') {
+            result = slots[pos];
+            bytesShared += len + 1;
+            break;
+        }
+        pos = (pos + 1) & (slotCount - 1);
+    }
+    if (!result) {
+        result = copy(str, len);
+        slots[pos] = result;
+        slotsUsed++;
+    }
+
+    xSemaphoreGive(lock);
+    return result;
+}
+
+const char* StringPool::store(const char* str, size_t len) {
+    if (len == 0) {
+        return "";
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const char* result = copy(str, len);
+    xSemaphoreGive(lock);
+    return result;
+}
+
+void StringPool::reset() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    slots = nullptr;
+    slotCount = 0;
+    slotsUsed = 0;
+    stringCount = 0;
+    bytesStored = 0;
+    bytesShared = 0;
+    xSemaphoreGive(lock);
+}
+
+void StringPool::logStats() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ESP_LOGI(TAG, "%d strings, %d bytes, %d bytes shared by interning",
+             (int)stringCount, (int)bytesStored, (int)bytesShared);
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,327 @@
+#include "tls_resume_transport.hpp"
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/select.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include "esp_log.h"
+
+static const char* TAG = "[TLS Resume]";
+
+// A kept peer certificate is serialized with the session and does not fit a slot
+#if CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
+#warning "CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE makes sessions outgrow TLS_SESSION_MAX_LEN"
+#endif
+
+// Survives deep sleep, lost on power cycle
+struct SessionSlot {
+    char host[64];
+    uint16_t len;
+    uint8_t data[TLS_SESSION_MAX_LEN];
+};
+
+RTC_DATA_ATTR static SessionSlot sessionSlots[TLS_SESSION_CACHE_SLOTS];
+RTC_DATA_ATTR static uint8_t nextSlot;
+RTC_DATA_ATTR static uint32_t handshakeCount;
+RTC_DATA_ATTR static uint32_t resumedCount;
+
+// Fetch workers connect concurrently, slots are only touched while holding
+// this mutex. Copying a slot takes too long for a spinlock.
+static SemaphoreHandle_t slotMutex() {
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    return mutex;
+}
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+struct TlsContext {
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt cacert;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_net_context net;
+    bool connected;
+    bool certificateSeen; // Set by the verify callback, only runs on full handshakes
+};
+
+// Callers must hold slotMutex()
+static SessionSlot* findSlot(const char* host, bool create) {
+    for (int i = 0; i < TLS_SESSION_CACHE_SLOTS; i++) {
+        if (strncmp(sessionSlots[i].host, host, sizeof(sessionSlots[i].host)) == 0) {
+            return &sessionSlots[i];
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+    SessionSlot* slot = &sessionSlots[nextSlot];
+    nextSlot = (nextSlot + 1) % TLS_SESSION_CACHE_SLOTS;
+    memset(slot, 0, sizeof(*slot));
+    strncpy(slot->host, host, sizeof(slot->host) - 1);
+    return slot;
+}
+
+static int verifyCallback(void* data, mbedtls_x509_crt*, int, uint32_t*) {
+    static_cast<TlsContext*>(data)->certificateSeen = true;
+    return 0; // Chain verification itself is left to mbedTLS
+}
+
+static void saveSession(TlsContext* ctx, const char* host) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+
+    uint8_t* buffer = static_cast<uint8_t*>(malloc(TLS_SESSION_MAX_LEN));
+    if (buffer && mbedtls_ssl_get_session(&ctx->ssl, &session) == 0) {
+        size_t len = 0;
+        int ret = mbedtls_ssl_session_save(&session, buffer, TLS_SESSION_MAX_LEN, &len);
+        if (ret != 0) {
+            ESP_LOGW(TAG, "Session for %s not cached: -0x%x", host, -ret);
+            len = 0;
+        } else {
+            ESP_LOGI(TAG, "Cached %d byte session for %s", (int)len, host);
+        }
+
+        xSemaphoreTake(slotMutex(), portMAX_DELAY);
+        SessionSlot* slot = findSlot(host, true);
+        memcpy(slot->data, buffer, len);
+        slot->len = len;
+        xSemaphoreGive(slotMutex());
+    }
+    free(buffer);
+    mbedtls_ssl_session_free(&session);
+}
+
+// Copies the cached session for host into buffer, returns its length
+static size_t loadSession(const char* host, uint8_t* buffer) {
+    size_t len = 0;
+    xSemaphoreTake(slotMutex(), portMAX_DELAY);
+    SessionSlot* slot = findSlot(host, false);
+    if (slot) {
+        len = slot->len;
+        memcpy(buffer, slot->data, len);
+    }
+    xSemaphoreGive(slotMutex());
+    return len;
+}
+
+static void forgetSession(const char* host) {
+    xSemaphoreTake(slotMutex(), portMAX_DELAY);
+    SessionSlot* slot = findSlot(host, false);
+    if (slot) {
+        slot->len = 0;
+    }
+    xSemaphoreGive(slotMutex());
+}
+
+static void closeConnection(TlsContext* ctx) {
+    if (ctx->connected) {
+        mbedtls_ssl_close_notify(&ctx->ssl);
+    }
+    mbedtls_net_free(&ctx->net);
+    mbedtls_ssl_session_reset(&ctx->ssl);
+    ctx->connected = false;
+}
+
+static int tlsConnect(esp_transport_handle_t t, const char* host, int port, int timeout_ms) {
+    TlsContext* ctx = static_cast<TlsContext*>(esp_transport_get_context_data(t));
+    closeConnection(ctx);
+
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%d", port);
+    int ret = mbedtls_net_connect(&ctx->net, host, portStr, MBEDTLS_NET_PROTO_TCP);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Connect to %s failed: -0x%x", host, -ret);
+        return -1;
+    }
+
+    mbedtls_ssl_conf_read_timeout(&ctx->conf, timeout_ms);
+    mbedtls_ssl_set_hostname(&ctx->ssl, host);
+    mbedtls_ssl_set_bio(&ctx->ssl, &ctx->net, mbedtls_net_send, nullptr, mbedtls_net_recv_timeout);
+
+    // Offer the session from the previous connection to this host, if any
+    bool offered = false;
+    uint8_t* buffer = static_cast<uint8_t*>(malloc(TLS_SESSION_MAX_LEN));
+    size_t len = buffer ? loadSession(host, buffer) : 0;
+    if (len > 0) {
+        mbedtls_ssl_session saved;
+        mbedtls_ssl_session_init(&saved);
+        if (mbedtls_ssl_session_load(&saved, buffer, len) == 0 &&
+            mbedtls_ssl_set_session(&ctx->ssl, &saved) == 0) {
+            offered = true;
+        } else {
+            forgetSession(host);
+        }
+        mbedtls_ssl_session_free(&saved);
+    }
+    free(buffer);
+
+    ctx->certificateSeen = false;
+    while ((ret = mbedtls_ssl_handshake(&ctx->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(TAG, "Handshake with %s failed: -0x%x", host, -ret);
+            forgetSession(host); // Do not offer a session that may have caused this
+            mbedtls_net_free(&ctx->net);
+            mbedtls_ssl_session_reset(&ctx->ssl);
+            return -1;
+        }
+    }
+    ctx->connected = true;
+
+    // The server only sends its certificate chain on a full handshake
+    bool resumed = offered && !ctx->certificateSeen;
+    portENTER_CRITICAL(&statsLock);
+    handshakeCount++;
+    if (resumed) {
+        resumedCount++;
+    }
+    portEXIT_CRITICAL(&statsLock);
+    ESP_LOGI(TAG, "%s handshake with %s", resumed ? "Abbreviated" : "Full", host);
+
+    saveSession(ctx, host);
+    return 0;
+}
+
+static int tlsRead(esp_transport_handle_t t, char* buffer, int len, int timeout_ms) {
+    TlsContext* ctx = static_cast<TlsContext*>(esp_transport_get_context_data(t));
+    mbedtls_ssl_conf_read_timeout(&ctx->conf, timeout_ms);
+
+    int ret = mbedtls_ssl_read(&ctx->ssl, reinterpret_cast<unsigned char*>(buffer), len);
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_TIMEOUT || ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    ESP_LOGE(TAG, "Read failed: -0x%x", -ret);
+    return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+}
+
+static int tlsWrite(esp_transport_handle_t t, const char* buffer, int len, int timeout_ms) {
+    TlsContext* ctx = static_cast<TlsContext*>(esp_transport_get_context_data(t));
+    int written = 0;
+    while (written < len) {
+        int ret = mbedtls_ssl_write(&ctx->ssl, reinterpret_cast<const unsigned char*>(buffer) + written, len - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(TAG, "Write failed: -0x%x", -ret);
+            return -1;
+        }
+    }
+    return written;
+}
+
+static int tlsPoll(esp_transport_handle_t t, int timeout_ms, bool forRead) {
+    TlsContext* ctx = static_cast<TlsContext*>(esp_transport_get_context_data(t));
+    if (forRead && mbedtls_ssl_get_bytes_avail(&ctx->ssl) > 0) {
+        return 1; // Already decrypted and waiting
+    }
+
+    fd_set fds, errfds;
+    FD_ZERO(&fds);
+    FD_ZERO(&errfds);
+    FD_SET(ctx->net.fd, &fds);
+    FD_SET(ctx->net.fd, &errfds);
+    struct timeval tv = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    int ret = select(ctx->net.fd + 1, forRead ? &fds : nullptr, forRead ? nullptr : &fds, &errfds, timeout_ms < 0 ? nullptr : &tv);
+    if (ret > 0 && FD_ISSET(ctx->net.fd, &errfds)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int tlsPollRead(esp_transport_handle_t t, int timeout_ms) {
+    return tlsPoll(t, timeout_ms, true);
+}
+
+static int tlsPollWrite(esp_transport_handle_t t, int timeout_ms) {
+    return tlsPoll(t, timeout_ms, false);
+}
+
+static int tlsClose(esp_transport_handle_t t) {
+    closeConnection(static_cast<TlsContext*>(esp_transport_get_context_data(t)));
+    return 0;
+}
+
+static void freeContext(TlsContext* ctx) {
+    mbedtls_net_free(&ctx->net);
+    mbedtls_ssl_free(&ctx->ssl);
+    mbedtls_ssl_config_free(&ctx->conf);
+    mbedtls_x509_crt_free(&ctx->cacert);
+    mbedtls_ctr_drbg_free(&ctx->ctr_drbg);
+    mbedtls_entropy_free(&ctx->entropy);
+    free(ctx);
+}
+
+static int tlsDestroy(esp_transport_handle_t t) {
+    TlsContext* ctx = static_cast<TlsContext*>(esp_transport_get_context_data(t));
+    closeConnection(ctx);
+    freeContext(ctx);
+    return 0;
+}
+
+esp_transport_handle_t TlsResumeTransport::create(const char* certPem, size_t certLen) {
+    TlsContext* ctx = static_cast<TlsContext*>(calloc(1, sizeof(TlsContext)));
+    if (!ctx) {
+        return nullptr;
+    }
+
+    mbedtls_ssl_init(&ctx->ssl);
+    mbedtls_ssl_config_init(&ctx->conf);
+    mbedtls_x509_crt_init(&ctx->cacert);
+    mbedtls_entropy_init(&ctx->entropy);
+    mbedtls_ctr_drbg_init(&ctx->ctr_drbg);
+    mbedtls_net_init(&ctx->net);
+
+    int ret = mbedtls_ctr_drbg_seed(&ctx->ctr_drbg, mbedtls_entropy_func, &ctx->entropy, nullptr, 0);
+    if (ret == 0) ret = mbedtls_x509_crt_parse(&ctx->cacert, reinterpret_cast<const unsigned char*>(certPem), certLen);
+    if (ret == 0) ret = mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret == 0) {
+        mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->cacert, nullptr);
+        mbedtls_ssl_conf_rng(&ctx->conf, mbedtls_ctr_drbg_random, &ctx->ctr_drbg);
+        mbedtls_ssl_conf_verify(&ctx->conf, verifyCallback, ctx);
+        mbedtls_ssl_conf_session_tickets(&ctx->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+        ret = mbedtls_ssl_setup(&ctx->ssl, &ctx->conf);
+    }
+
+    esp_transport_handle_t t = ret == 0 ? esp_transport_init() : nullptr;
+    if (!t) {
+        ESP_LOGE(TAG, "Failed to set up TLS transport: -0x%x", -ret);
+        freeContext(ctx);
+        return nullptr;
+    }
+
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_default_port(t, 443);
+    esp_transport_set_func(t, tlsConnect, tlsRead, tlsWrite, tlsClose, tlsPollRead, tlsPollWrite, tlsDestroy);
+    return t;
+}
+
+uint32_t TlsResumeTransport::getHandshakeCount() {
+    return handshakeCount;
+}
+
+uint32_t TlsResumeTransport::getResumedCount() {
+    return resumedCount;
+}
+
+void TlsResumeTransport::logStats() {
+    ESP_LOGI(TAG, "Session resumption: %u of %u handshakes since power-on",
+             (unsigned)resumedCount, (unsigned)handshakeCount);
+}
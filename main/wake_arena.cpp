@@ -0,0 +1,122 @@
+#include "wake_arena.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "app_config.hpp"
+
+static const char* TAG = "[Wake Arena]";
+
+WakeArena& WakeArena::shared() {
+    static WakeArena arena;
+    return arena;
+}
+
+WakeArena::WakeArena()
+    : blocks(nullptr), used(0), peak(0), capacity(0), blockCount(0), lock(xSemaphoreCreateMutex()) {}
+
+WakeArena::~WakeArena() {
+    reset();
+    heap_caps_free(blocks);
+    vSemaphoreDelete(lock);
+}
+
+void* WakeArena::allocate(size_t size, size_t align) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    char* result = nullptr;
+    if (blocks) {
+        uintptr_t top = reinterpret_cast<uintptr_t>(blocks->data() + blocks->used);
+        size_t padding = (align - top % align) % align;
+        if (blocks->used + padding + size <= blocks->size) {
+            result = blocks->data() + blocks->used + padding;
+            blocks->used += padding + size;
+            used += padding + size;
+        }
+    }
+
+    if (!result) {
+        // Oversized requests get a block of their own
+        size_t blockSize = size + align > WAKE_ARENA_BLOCK ? size + align : WAKE_ARENA_BLOCK;
+        Block* block = static_cast<Block*>(heap_caps_malloc(sizeof(Block) + blockSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT));
+        if (!block) {
+            ESP_LOGE(TAG, "Out of PSRAM for a %d byte block (%d bytes in use)", (int)blockSize, (int)used);
+            abort();
+        }
+        block->next = blocks;
+        block->size = blockSize;
+        blocks = block;
+        capacity += blockSize;
+        blockCount++;
+
+        uintptr_t top = reinterpret_cast<uintptr_t>(block->data());
+        size_t padding = (align - top % align) % align;
+        result = block->data() + padding;
+        block->used = padding + size;
+        used += padding + size;
+    }
+
+    if (used > peak) {
+        peak = used;
+    }
+    xSemaphoreGive(lock);
+    return result;
+}
+
+void WakeArena::release(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (blocks && static_cast<char*>(ptr) + size == blocks->data() + blocks->used) {
+        blocks->used -= size;
+        used -= size;
+    }
+    xSemaphoreGive(lock);
+}
+
+char* WakeArena::copy(const char* str, size_t len) {
+    char* dest = static_cast<char*>(allocate(len + 1, 1));
+    memcpy(dest, str, len);
+    dest[len] = '\0';
+    return dest;
+}
+
+void WakeArena::reset() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // The oldest block is the first one a new cycle needs, keep it
+    while (blocks && blocks->next) {
+        Block* next = blocks->next;
+        capacity -= blocks->size;
+        heap_caps_free(blocks);
+        blocks = next;
+        blockCount--;
+    }
+    if (blocks) {
+        blocks->used = 0;
+    }
+    used = 0;
+    xSemaphoreGive(lock);
+}
+
+void WakeArena::logStats() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    ESP_LOGI(TAG, "%d bytes in use, peak %d, %d bytes in %d blocks", (int)used, (int)peak, (int)capacity, blockCount);
+    xSemaphoreGive(lock);
+}
+
+void WakeArena::logHeap(const char* when) {
+    const uint32_t caps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM};
+    const char* names[] = {"internal", "PSRAM"};
+    for (int i = 0; i < 2; i++) {
+        size_t freeBytes = heap_caps_get_free_size(caps[i]);
+        size_t largest = heap_caps_get_largest_free_block(caps[i]);
+        int fragmentation = freeBytes ? 100 - (int)(largest * 100 / freeBytes) : 0;
+        ESP_LOGI(TAG, "Heap %s %s: %d bytes free, largest block %d, %d%% fragmented",
+                 names[i], when, (int)freeBytes, (int)largest, fragmentation);
+    }
+}
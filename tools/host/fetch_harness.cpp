@@ -0,0 +1,208 @@
+// Host driver for the fetch pipeline. Runs the firmware's GoogleCalendar
+// against tools/mock_gcal_server.py: token refresh, full, incremental and
+// conditional syncs, the batch request with its per-calendar fallback, and
+// the 401 -> refresh -> retry sequence of Application::fetchCalendarEvents.
+// Requests go through HttpSession and the esp_http_client stand-in in
+// host_idf.cpp, events are stored in an in-memory NVS.
+//
+//     make -C tools/host harness    # starts and stops the mock server itself
+//
+//     fetch_harness sync <events> <latency ms>
+//         Mock started with --events <events> --latency <latency ms> --expired-token expired-token
+//     fetch_harness refresh-fails
+//         Mock started with --refresh-fails --expired-token expired-token
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "app_config.hpp"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+#include "esp_timer.h"
+#include "g_calendar.hpp"
+#include "g_calendar_config.hpp"
+#include "g_calendar_store.hpp"
+#include "response_arena.hpp"
+#include "string_pool.hpp"
+#include "wake_arena.hpp"
+
+#define EXPIRED_TOKEN "expired-token" // Answered with 401 by the mock server
+
+static int failures = 0;
+static int latencyMs = 0;
+static int64_t scenarioStart = 0;
+static int connections = 0;  // Opened over the whole run
+
+static void expect(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        failures++;
+    }
+}
+
+// Each scenario starts from an empty wake, as after deep sleep. The NVS
+// store and the GoogleCalendar with its open connections carry over.
+static void beginScenario() {
+    StringPool::shared().reset();
+    WakeArena::shared().reset();
+    HostHeap::peak() = HostHeap::live();
+    HostHttp::reset();
+    scenarioStart = esp_timer_get_time();
+}
+
+static void endScenario(const char* name, size_t events) {
+    int ms = (int)((esp_timer_get_time() - scenarioStart) / 1000);
+    printf("%-13s %3d requests %2d connects %9zu bytes %5zu events %6d ms   peak heap %7zu, wake arena %7zu, "
+           "response arena %6zu\n",
+           name, HostHttp::requests(), HostHttp::connections(), HostHttp::bytes(), events, ms, HostHeap::peak(),
+           WakeArena::shared().getPeak(), ResponseArena::getHighWaterMark());
+    connections += HostHttp::connections();
+    // Every request waits out the mock server's latency
+    expect(ms >= HostHttp::requests() * latencyMs, "latency was applied to every request");
+}
+
+static std::string calendarId(int index) {
+    return "family" + std::to_string(index) + "@example.com";
+}
+
+// Pages one listing of the mock server takes at MAX_RESULTS_PER_PAGE
+static int pagesFor(int events) {
+    return events > 0 ? (events + MAX_RESULTS_PER_PAGE - 1) / MAX_RESULTS_PER_PAGE : 1;
+}
+
+// One calendar through syncEvents, as a fetch pool worker does it
+static void syncScenario(GoogleCalendar& gCalendar, const std::string& token, const char* name, int mockEvents,
+                         int requests, bool expectUnchanged) {
+    beginScenario();
+    size_t count;
+    {
+        EventList events;
+        bool unchanged = false;
+        esp_err_t err = gCalendar.syncEvents(token, calendarId(0), events, unchanged);
+        expect(err == ESP_OK, "syncEvents succeeds");
+        expect(unchanged == expectUnchanged, expectUnchanged ? "304 reported as unchanged" : "changes reported");
+        expect((int)events.size() == mockEvents, "every event of the month is returned");
+        expect(HostHttp::requests() == requests, "expected number of requests");
+        count = events.size();
+    }
+    endScenario(name, count);
+}
+
+// Several calendars through syncEventsBatch, whatever it leaves goes
+// through syncEvents on the same object, as in fetchCalendarEvents
+static void batchScenario(GoogleCalendar& gCalendar, const std::string& token, const char* name, int calendars,
+                          int mockEvents, int requests, bool expectUnchanged) {
+    beginScenario();
+    size_t count = 0;
+    {
+        std::vector<CalendarFetchJob> jobs(calendars);
+        for (int i = 0; i < calendars; i++) {
+            jobs[i].calendarId = calendarId(i + 1);
+            jobs[i].result = ESP_FAIL;
+            jobs[i].unchanged = false;
+        }
+        gCalendar.syncEventsBatch(token, jobs);
+        for (auto& job : jobs) {
+            if (job.result != ESP_OK) {
+                job.result = gCalendar.syncEvents(token, job.calendarId, job.events, job.unchanged);
+            }
+            expect(job.result == ESP_OK, "every calendar of the batch is synced");
+            expect(job.unchanged == expectUnchanged, expectUnchanged ? "304 parts reported as unchanged" :
+                                                                       "changes reported");
+            expect((int)job.events.size() == mockEvents, "every event of the month is returned");
+            count += job.events.size();
+        }
+        expect(HostHttp::requests() == requests, "expected number of requests");
+    }
+    endScenario(name, count);
+}
+
+static void runSync(int mockEvents, int calendars) {
+    GoogleCalendar gCalendar(CalendarConfig::getClientId(), CalendarConfig::getClientSecret(),
+                             CalendarConfig::getRefreshToken());
+    int pages = pagesFor(mockEvents);
+    expect(pages > 1, "the listing needs more than one page (raise --events)");
+
+    beginScenario();
+    int expiresIn = 0;
+    std::string token = gCalendar.refreshAccessToken(expiresIn);
+    expect(!token.empty() && expiresIn > 0, "token refresh returns a token and its lifetime");
+    endScenario("token", 0);
+
+    // Empty store: full listing page by page, then the stored sync token
+    // without an ETag, then the same query again, which the mock answers 304
+    syncScenario(gCalendar, token, "full, paged", mockEvents, pages, false);
+    syncScenario(gCalendar, token, "incremental", mockEvents, 1, false);
+    syncScenario(gCalendar, token, "304", mockEvents, 1, true);
+
+    // Multi-page calendars fall out of the batch, later rounds fit into one request
+    batchScenario(gCalendar, token, "batch, paged", calendars, mockEvents, 1 + calendars * pages, false);
+    batchScenario(gCalendar, token, "batch incr.", calendars, mockEvents, 1, false);
+    batchScenario(gCalendar, token, "batch 304", calendars, mockEvents, 1, true);
+
+    // A rejected token fails the calendar, after a refresh the retry succeeds
+    beginScenario();
+    size_t count;
+    {
+        EventList events;
+        bool unchanged = false;
+        const std::string id = calendarId(calendars + 1);
+        esp_err_t err = gCalendar.syncEvents(EXPIRED_TOKEN, id, events, unchanged);
+        expect(err != ESP_OK && HostHttp::lastStatus() == 401, "expired token is rejected with 401");
+        expect(events.empty(), "a rejected sync returns no events");
+        token = gCalendar.refreshAccessToken(expiresIn);
+        expect(!token.empty(), "token refresh after the 401 succeeds");
+        err = gCalendar.syncEvents(token, id, events, unchanged);
+        expect(err == ESP_OK && (int)events.size() == mockEvents, "retry with the new token succeeds");
+        expect(HostHttp::requests() == 2 + pages, "401, refresh and the full listing");
+        count = events.size();
+    }
+    endScenario("401, refresh", count);
+
+    // One GoogleCalendar keeps a single connection per host for all of it
+    expect(connections == 2, "one connection to each host for the whole run");
+}
+
+static void runRefreshFails() {
+    GoogleCalendar gCalendar(CalendarConfig::getClientId(), CalendarConfig::getClientSecret(),
+                             CalendarConfig::getRefreshToken());
+
+    // fetchCalendarEvents keeps the old token when the refresh fails, the
+    // calendar then fails and nothing stored can stand in for it
+    beginScenario();
+    {
+        int expiresIn = 0;
+        std::string token = gCalendar.refreshAccessToken(expiresIn);
+        expect(token.empty() && HostHttp::lastStatus() == 400, "rejected refresh returns no token");
+
+        EventList events;
+        bool unchanged = false;
+        esp_err_t err = gCalendar.syncEvents(EXPIRED_TOKEN, calendarId(0), events, unchanged);
+        expect(err != ESP_OK && HostHttp::lastStatus() == 401, "old token is still rejected");
+        expect(!GoogleCalendar::loadStoredEvents(calendarId(0), events), "no stored copy to fall back to");
+        expect(HostHttp::requests() == 2, "one refresh and one listing");
+    }
+    endScenario("refresh fails", 0);
+}
+
+int main(int argc, char** argv) {
+    const char* mode = argc > 1 ? argv[1] : "sync";
+    int mockEvents = argc > 2 ? atoi(argv[2]) : 120;
+    latencyMs = argc > 3 ? atoi(argv[3]) : 0;
+    const int calendars = 3;
+
+    CalendarEventStore::init();
+    if (strcmp(mode, "sync") == 0) {
+        runSync(mockEvents, calendars);
+    } else if (strcmp(mode, "refresh-fails") == 0) {
+        runRefreshFails();
+    } else {
+        fprintf(stderr, "Unknown mode %s\n", mode);
+        return 2;
+    }
+    GoogleCalendar::logStats();
+
+    printf("%s\n", failures == 0 ? "All scenarios passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
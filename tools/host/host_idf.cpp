@@ -0,0 +1,420 @@
+// Host implementations behind stubs/esp_http_client.h and stubs/nvs.h, plus
+// the embedded certificate the firmware links in
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <strings.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "nvs_flash.h"
+
+static const char* TAG = "[Host IDF]";
+
+// g_calendar.cpp takes the size of the certificate from these two labels.
+// Plain HTTP never reads it.
+asm(".section .rodata\n"
+    ".globl _binary_server_googleapis_root_cert_pem_start\n"
+    "_binary_server_googleapis_root_cert_pem_start:\n"
+    ".byte 0\n"
+    ".globl _binary_server_googleapis_root_cert_pem_end\n"
+    "_binary_server_googleapis_root_cert_pem_end:\n"
+    ".previous\n");
+
+struct esp_http_client {
+    http_event_handle_cb handler;
+    void* userData;
+    int bufferSize;
+    std::string host;
+    std::string port;
+    std::string path;
+    esp_http_client_method_t method;
+    const char* postData;
+    int postLength;
+    std::vector<std::pair<std::string, std::string>> headers;
+    int fd;
+    std::string connectedTo;  // host:port of fd
+    std::string pending;      // Read past the end of the last response
+    int statusCode;
+};
+
+static bool parseUrl(esp_http_client* client, const char* url) {
+    if (strncmp(url, "http://", 7) != 0) {
+        ESP_LOGE(TAG, "Only http:// is available on the host: %s", url);
+        return false;
+    }
+    std::string rest = url + 7;
+    size_t slash = rest.find('/');
+    std::string authority = rest.substr(0, slash);
+    client->path = slash == std::string::npos ? "/" : rest.substr(slash);
+    size_t colon = authority.find(':');
+    client->host = authority.substr(0, colon);
+    client->port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+    return true;
+}
+
+static void emit(esp_http_client* client, esp_http_client_event_id_t id, const char* data = nullptr, int len = 0,
+                 const char* key = nullptr, const char* value = nullptr) {
+    if (!client->handler) {
+        return;
+    }
+    esp_http_client_event_t evt = {};
+    evt.event_id = id;
+    evt.client = client;
+    evt.data = (void*)data;
+    evt.data_len = len;
+    evt.user_data = client->userData;
+    evt.header_key = (char*)key;
+    evt.header_value = (char*)value;
+    client->handler(&evt);
+}
+
+static bool connectClient(esp_http_client* client) {
+    std::string target = client->host + ":" + client->port;
+    if (client->fd >= 0 && client->connectedTo == target) {
+        return true;
+    }
+    esp_http_client_close(client);
+
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addr = nullptr;
+    if (getaddrinfo(client->host.c_str(), client->port.c_str(), &hints, &addr) != 0) {
+        ESP_LOGE(TAG, "Cannot resolve %s", client->host.c_str());
+        return false;
+    }
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    bool connected = fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) == 0;
+    freeaddrinfo(addr);
+    if (!connected) {
+        ESP_LOGE(TAG, "Cannot connect to %s, is the mock server running?", target.c_str());
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    client->fd = fd;
+    client->connectedTo = target;
+    HostHttp::connections()++;
+    emit(client, HTTP_EVENT_ON_CONNECTED);
+    return true;
+}
+
+// Reads until pending holds at least want bytes, false on EOF
+static bool fill(esp_http_client* client, size_t want) {
+    char buf[4096];
+    while (client->pending.size() < want) {
+        ssize_t n = read(client->fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return false;
+        }
+        client->pending.append(buf, n);
+    }
+    return true;
+}
+
+// One request and response on the open connection. fresh is false when the
+// server may have closed an idle keep-alive connection in the meantime.
+static esp_err_t exchange(esp_http_client* client, bool& fresh) {
+    std::string out = std::string(client->method == HTTP_METHOD_POST ? "POST " : "GET ") + client->path +
+                      " HTTP/1.1\r\nHost: " + client->host + "\r\n";
+    bool userAgent = false;
+    for (const auto& header : client->headers) {
+        out += header.first + ": " + header.second + "\r\n";
+        userAgent |= strcasecmp(header.first.c_str(), "User-Agent") == 0;
+    }
+    if (!userAgent) {
+        out += "User-Agent: ESP32 HTTP Client/1.0\r\n";
+    }
+    if (client->method == HTTP_METHOD_POST) {
+        out += "Content-Length: " + std::to_string(client->postLength) + "\r\n";
+    }
+    out += "\r\n";
+    if (client->postData) {
+        out.append(client->postData, client->postLength);
+    }
+    if (write(client->fd, out.data(), out.size()) != (ssize_t)out.size()) {
+        return ESP_ERR_HTTP_WRITE_DATA;
+    }
+
+    size_t headEnd;
+    while ((headEnd = client->pending.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(client, client->pending.size() + 1)) {
+            return ESP_ERR_HTTP_FETCH_HEADER;
+        }
+    }
+    fresh = true;
+    std::string head = client->pending.substr(0, headEnd + 2);
+    client->pending.erase(0, headEnd + 4);
+
+    client->statusCode = atoi(head.c_str() + head.find(' ') + 1);
+    HostHttp::lastStatus() = client->statusCode;
+    long contentLength = -1;
+    bool keepAlive = true;
+    size_t pos = head.find("\r\n") + 2;
+    while (pos < head.size()) {
+        size_t next = head.find("\r\n", pos);
+        std::string line = head.substr(pos, next - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string key = line.substr(0, colon);
+            size_t start = line.find_first_not_of(' ', colon + 1);
+            std::string value = start == std::string::npos ? std::string() : line.substr(start);
+            if (strcasecmp(key.c_str(), "Content-Length") == 0) contentLength = atol(value.c_str());
+            if (strcasecmp(key.c_str(), "Connection") == 0) keepAlive = strcasecmp(value.c_str(), "close") != 0;
+            emit(client, HTTP_EVENT_ON_HEADER, nullptr, 0, key.c_str(), value.c_str());
+        }
+        pos = next + 2;
+    }
+
+    // Bodies are framed by Content-Length or, failing that, by the end of the connection
+    if (client->statusCode == 304 || client->statusCode == 204) {
+        contentLength = 0;
+    }
+    size_t remaining = contentLength < 0 ? SIZE_MAX : contentLength;
+    while (remaining > 0) {
+        if (client->pending.empty() && !fill(client, 1)) {
+            if (contentLength >= 0) {
+                return ESP_ERR_HTTP_FETCH_HEADER;
+            }
+            keepAlive = false;
+            break;
+        }
+        size_t len = std::min(std::min(client->pending.size(), remaining), (size_t)client->bufferSize);
+        HostHttp::bytes() += len;
+        emit(client, HTTP_EVENT_ON_DATA, client->pending.data(), len);
+        client->pending.erase(0, len);
+        remaining -= len;
+    }
+    emit(client, HTTP_EVENT_ON_FINISH);
+    if (!keepAlive) {
+        esp_http_client_close(client);
+    }
+    return ESP_OK;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config) {
+    esp_http_client* client = new esp_http_client();
+    client->handler = config->event_handler;
+    client->userData = config->user_data;
+    client->bufferSize = config->buffer_size > 0 ? config->buffer_size : 512;
+    client->method = HTTP_METHOD_GET;
+    client->postData = nullptr;
+    client->postLength = 0;
+    client->fd = -1;
+    client->statusCode = 0;
+    if (!parseUrl(client, config->url)) {
+        delete client;
+        return nullptr;
+    }
+    return client;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+    esp_http_client_close(client);
+    delete client;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_user_data(esp_http_client_handle_t client, void* data) {
+    client->userData = data;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char* url) {
+    return parseUrl(client, url) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char* data, int len) {
+    client->postData = data;
+    client->postLength = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value) {
+    esp_http_client_delete_header(client, key);
+    client->headers.push_back(std::make_pair(std::string(key), std::string(value)));
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char* key) {
+    for (auto it = client->headers.begin(); it != client->headers.end(); ++it) {
+        if (strcasecmp(it->first.c_str(), key) == 0) {
+            client->headers.erase(it);
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+    client->statusCode = 0;
+    HostHttp::requests()++;
+    bool reused = client->fd >= 0;
+    if (!connectClient(client)) {
+        return ESP_ERR_HTTP_CONNECT;
+    }
+    bool fresh = !reused;
+    esp_err_t err = exchange(client, fresh);
+    if (err != ESP_OK && !fresh) {
+        // The server dropped the idle connection, try once more on a new one
+        esp_http_client_close(client);
+        if (!connectClient(client)) {
+            return ESP_ERR_HTTP_CONNECT;
+        }
+        err = exchange(client, fresh);
+    }
+    return err;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        client->pending.clear();
+        emit(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) {
+    return client->statusCode;
+}
+
+// NVS: one map per partition and namespace, values kept as bytes (strings with their NUL)
+
+#define HOST_NVS_ENTRIES (63 * 126) // A 256 KB partition: 64 pages of 126 entries, one kept free
+
+struct NvsNamespace {
+    std::string partition;
+    std::map<std::string, std::vector<uint8_t>> values;
+};
+
+static std::map<std::string, NvsNamespace>& nvsNamespaces() {
+    static std::map<std::string, NvsNamespace> namespaces;
+    return namespaces;
+}
+
+struct NvsHandle {
+    NvsNamespace* space;
+    bool readOnly;
+};
+
+static std::map<nvs_handle_t, NvsHandle>& nvsHandles() {
+    static std::map<nvs_handle_t, NvsHandle> handles;
+    return handles;
+}
+
+static NvsHandle* nvsHandle(nvs_handle_t handle) {
+    auto it = nvsHandles().find(handle);
+    return it == nvsHandles().end() ? nullptr : &it->second;
+}
+
+esp_err_t nvs_flash_init_partition(const char*) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase_partition(const char* part_name) {
+    for (auto& entry : nvsNamespaces()) {
+        if (entry.second.partition == part_name) {
+            entry.second.values.clear();
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char* part_name, const char* namespace_name, nvs_open_mode_t open_mode,
+                                  nvs_handle_t* out_handle) {
+    static nvs_handle_t next = 1;
+    std::string name = std::string(part_name) + "/" + namespace_name;
+    auto it = nvsNamespaces().find(name);
+    if (it == nvsNamespaces().end()) {
+        if (open_mode == NVS_READONLY) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        it = nvsNamespaces().insert(std::make_pair(name, NvsNamespace())).first;
+        it->second.partition = part_name;
+    }
+    *out_handle = next++;
+    nvsHandles()[*out_handle] = NvsHandle{&it->second, open_mode == NVS_READONLY};
+    return ESP_OK;
+}
+
+static esp_err_t nvsSet(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    NvsHandle* h = nvsHandle(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->readOnly) return ESP_ERR_NVS_READ_ONLY;
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    h->space->values[key].assign(bytes, bytes + length);
+    return ESP_OK;
+}
+
+static esp_err_t nvsGet(nvs_handle_t handle, const char* key, void* out, size_t* length) {
+    NvsHandle* h = nvsHandle(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it = h->space->values.find(key);
+    if (it == h->space->values.end()) return ESP_ERR_NVS_NOT_FOUND;
+    if (out) {
+        if (*length < it->second.size()) return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out, it->second.data(), it->second.size());
+    }
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value) {
+    return nvsSet(handle, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length) {
+    return nvsGet(handle, key, out_value, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    return nvsSet(handle, key, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    return nvsGet(handle, key, out_value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    NvsHandle* h = nvsHandle(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    return h->space->values.erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return nvsHandle(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    nvsHandles().erase(handle);
+}
+
+// One entry per 32 bytes of value plus a header, close enough for the size check in save()
+esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats) {
+    *nvs_stats = nvs_stats_t();
+    for (const auto& entry : nvsNamespaces()) {
+        if (entry.second.partition != part_name) {
+            continue;
+        }
+        nvs_stats->namespace_count++;
+        for (const auto& value : entry.second.values) {
+            nvs_stats->used_entries += 1 + (value.second.size() + 31) / 32;
+        }
+    }
+    nvs_stats->total_entries = HOST_NVS_ENTRIES;
+    nvs_stats->free_entries = HOST_NVS_ENTRIES - nvs_stats->used_entries;
+    nvs_stats->available_entries = nvs_stats->free_entries;
+    return ESP_OK;
+}
@@ -0,0 +1,47 @@
+// Host check of ResponseArena at the RESPONSE_ARENA_MAX boundary
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "response_arena.hpp"
+#include "app_config.hpp"
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    failures += ok ? 0 : 1;
+}
+
+int main() {
+    std::vector<char> chunk(4096, 'x');
+
+    // Fill to 63000 bytes, the arena grows to 61440 and then 65536 on the way
+    ResponseArena arena;
+    bool complete = true;
+    size_t written = 0;
+    while (written + chunk.size() <= 63000) {
+        complete &= arena.append(chunk.data(), chunk.size());
+        written += chunk.size();
+    }
+    complete &= arena.append(chunk.data(), 63000 - written);
+    expect(complete && arena.size() == 63000, "63000 bytes fit below the maximum");
+
+    // The next chunk would end at 67096, past the 65536 byte block
+    expect(!arena.append(chunk.data(), chunk.size()), "append past the maximum reports truncation");
+    expect(arena.size() == RESPONSE_ARENA_MAX - 1, "truncated body fills the arena exactly");
+    expect(arena.getCapacity() == RESPONSE_ARENA_MAX, "capacity stays at the maximum");
+    expect(arena.c_str()[arena.size()] == '\0', "truncated body is NUL-terminated");
+    expect(!arena.append("y", 1), "a full arena keeps refusing");
+
+    // One append that jumps straight over the maximum from an empty arena
+    ResponseArena big;
+    std::vector<char> huge(RESPONSE_ARENA_MAX + 100, 'z');
+    expect(!big.append(huge.data(), huge.size()), "oversized single append reports truncation");
+    expect(big.size() == RESPONSE_ARENA_MAX - 1, "oversized single append keeps what fits");
+
+    ResponseArena exact;
+    std::vector<char> fits(RESPONSE_ARENA_MAX - 1, 'w');
+    expect(exact.append(fits.data(), fits.size()), "a body of exactly the maximum minus the NUL fits");
+
+    return failures ? 1 : 0;
+}
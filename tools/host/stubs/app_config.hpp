@@ -0,0 +1,13 @@
+// Host build: the firmware's settings, with both Google endpoints on the mock
+// server. MOCK_URL comes from the Makefile.
+#pragma once
+#include_next "app_config.hpp"
+
+#ifndef MOCK_URL
+#define MOCK_URL "http://127.0.0.1:8080"
+#endif
+
+#undef GOOGLE_API_URL
+#undef GOOGLE_OAUTH_URL
+#define GOOGLE_API_URL   MOCK_URL
+#define GOOGLE_OAUTH_URL MOCK_URL "/token"
@@ -0,0 +1,29 @@
+// Host stand-in for ESP-IDF error codes
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+#define ESP_OK                   0
+#define ESP_FAIL                 -1
+#define ESP_ERR_NO_MEM           0x101
+#define ESP_ERR_INVALID_ARG      0x102
+#define ESP_ERR_INVALID_STATE    0x103
+#define ESP_ERR_INVALID_SIZE     0x104
+#define ESP_ERR_NOT_FOUND        0x105
+#define ESP_ERR_TIMEOUT          0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_NOT_FINISHED     0x10C
+
+// Numbers only, the harness has no name table
+static inline const char* esp_err_to_name(esp_err_t err) {
+    static char name[16];
+    snprintf(name, sizeof(name), "0x%x", err);
+    return name;
+}
+
+#define ESP_ERROR_CHECK(x) do { \
+    esp_err_t err_ = (x); \
+    if (err_ != ESP_OK) { fprintf(stderr, "%s failed: 0x%x\n", #x, err_); abort(); } \
+} while (0)
@@ -0,0 +1,39 @@
+// Host stand-in for the capability allocator, counting live bytes for peak memory
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+struct HostHeap {
+    static size_t& live() { static size_t bytes = 0; return bytes; }
+    static size_t& peak() { static size_t bytes = 0; return bytes; }
+};
+
+// Each block is prefixed with its size, padded to keep malloc's alignment
+#define HOST_HEAP_HEADER 16
+
+static inline void* heap_caps_realloc(void* ptr, size_t size, uint32_t) {
+    char* base = ptr ? (char*)ptr - HOST_HEAP_HEADER : NULL;
+    size_t old = base ? *(size_t*)base : 0;
+    base = (char*)realloc(base, size + HOST_HEAP_HEADER);
+    if (!base) return NULL;
+    *(size_t*)base = size;
+    HostHeap::live() += size - old;
+    if (HostHeap::live() > HostHeap::peak()) HostHeap::peak() = HostHeap::live();
+    return base + HOST_HEAP_HEADER;
+}
+static inline void* heap_caps_malloc(size_t size, uint32_t caps) { return heap_caps_realloc(NULL, size, caps); }
+static inline void heap_caps_free(void* ptr) {
+    if (!ptr) return;
+    char* base = (char*)ptr - HOST_HEAP_HEADER;
+    HostHeap::live() -= *(size_t*)base;
+    free(base);
+}
+
+// Only WakeArena::logHeap() asks, the host has nothing meaningful to report
+static inline size_t heap_caps_get_free_size(uint32_t) { return 0; }
+static inline size_t heap_caps_get_largest_free_block(uint32_t) { return 0; }
@@ -0,0 +1,9 @@
+// Host stand-in for the FreeRTOS bits the portable sources use, single threaded
+#pragma once
+#include <stdint.h>
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux)  ((void)(mux))
+#define portMAX_DELAY 0xffffffffu
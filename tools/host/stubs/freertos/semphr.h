@@ -0,0 +1,10 @@
+// Host stand-in for FreeRTOS mutexes, the harness runs on one thread
+#pragma once
+#include "FreeRTOS.h"
+
+typedef int* SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new int(0); }
+static inline void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+static inline int xSemaphoreTake(SemaphoreHandle_t, uint32_t) { return 1; }
+static inline int xSemaphoreGive(SemaphoreHandle_t) { return 1; }
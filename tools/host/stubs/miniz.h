@@ -0,0 +1,59 @@
+// Host stand-in for the ROM tinfl decoder GzipInflater uses, on top of zlib.
+// zlib keeps its own 32 KB history, so the caller's circular window is only
+// written to, never read back. zlib's state is carved out of the decompressor
+// itself so freeing that one block, as the firmware does, frees everything.
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE        32768
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef enum {
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    z_stream stream;
+    size_t poolUsed;
+    alignas(16) unsigned char pool[48 * 1024]; // inflate_state plus its window
+} tinfl_decompressor;
+
+static inline voidpf tinfl_host_alloc(voidpf opaque, uInt items, uInt size) {
+    tinfl_decompressor* r = (tinfl_decompressor*)opaque;
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    if (r->poolUsed + bytes > sizeof(r->pool)) return Z_NULL;
+    voidpf ptr = r->pool + r->poolUsed;
+    r->poolUsed += bytes;
+    return ptr;
+}
+
+static inline void tinfl_host_free(voidpf, voidpf) {}
+
+static inline void tinfl_init(tinfl_decompressor* r) {
+    r->poolUsed = 0;
+    r->stream = z_stream();
+    r->stream.zalloc = tinfl_host_alloc;
+    r->stream.zfree = tinfl_host_free;
+    r->stream.opaque = r;
+    inflateInit2(&r->stream, -MAX_WBITS);
+}
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize, uint8_t*,
+                                            uint8_t* outNext, size_t* outSize, uint32_t) {
+    r->stream.next_in = (Bytef*)in;
+    r->stream.avail_in = (uInt)*inSize;
+    r->stream.next_out = outNext;
+    r->stream.avail_out = (uInt)*outSize;
+    int ret = inflate(&r->stream, Z_NO_FLUSH);
+    *inSize -= r->stream.avail_in;
+    *outSize -= r->stream.avail_out;
+
+    if (ret == Z_STREAM_END) return TINFL_STATUS_DONE;
+    if (ret != Z_OK && ret != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+    return r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Google OAuth and Calendar endpoints used by the firmware.
+
+Point GOOGLE_API_URL and GOOGLE_OAUTH_URL in main/include/app_config.hpp at
+this server (plain http:// is fine) to exercise the whole fetch pipeline
+without a Google account, then compare the device's fetch stats log lines
+between runs.
+
+    python3 tools/mock_gcal_server.py --port 8080 --events 120 --page-size 50
+    python3 tools/mock_gcal_server.py --latency 300 --expired-token stale-token
+    python3 tools/mock_gcal_server.py --certfile cert.pem --keyfile key.pem
+
+Supported: token refresh, events.list with pagination (maxResults/pageToken),
+syncToken with 410 for unknown tokens, ETag/If-None-Match (304), gzip when the
+client asks for it, the multipart/mixed batch endpoint, added latency and 401s.
+`make -C tools/host harness` runs the firmware's GoogleCalendar against it,
+with --latency, --expired-token and, in a second run, --refresh-fails.
+"""
+
+import argparse
+import datetime
+import gzip
+import hashlib
+import json
+import random
+import signal
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, unquote, urlsplit
+
+ARGS = None
+STATS_LOCK = threading.Lock()
+STATS = {"requests": 0, "bytes_out": 0, "not_modified": 0, "unauthorized": 0, "batches": 0}
+TOKEN_COUNTER = [0]
+
+
+def count(key, amount=1):
+    with STATS_LOCK:
+        STATS[key] += amount
+
+
+def make_events(calendar_id):
+    """Deterministic events for this month, so ETags stay stable between runs."""
+    rng = random.Random(calendar_id)
+    today = datetime.date.today()
+    first = today.replace(day=1)
+    days_in_month = ((first + datetime.timedelta(days=32)).replace(day=1) - first).days
+
+    events = []
+    for i in range(ARGS.events):
+        day = first + datetime.timedelta(days=rng.randrange(days_in_month))
+        event = {
+            "id": "%s-%04d" % (hashlib.md5(calendar_id.encode()).hexdigest()[:8], i),
+            "status": "confirmed",
+            "summary": "Event %d on %s" % (i, day.isoformat()),
+            "description": "".join(rng.choice("abcdefgh ") for _ in range(rng.randrange(ARGS.description_bytes + 1))),
+            "creator": {"email": "someone@example.com"},
+            "organizer": {"displayName": calendar_id.split("@")[0][:8]},
+        }
+        if rng.random() < 0.3:
+            event["start"] = {"date": day.isoformat()}
+            event["end"] = {"date": (day + datetime.timedelta(days=1)).isoformat()}
+        else:
+            hour = rng.randrange(8, 20)
+            event["start"] = {"dateTime": "%sT%02d:00:00-08:00" % (day.isoformat(), hour)}
+            event["end"] = {"dateTime": "%sT%02d:00:00-08:00" % (day.isoformat(), hour + 1)}
+        events.append(event)
+    events.sort(key=lambda e: e["start"].get("date", e["start"].get("dateTime")))
+    return events
+
+
+def sync_token_for(calendar_id):
+    return "sync-" + hashlib.md5(calendar_id.encode()).hexdigest()[:12]
+
+
+def events_response(calendar_id, query, headers, authorization):
+    """Returns (status, extra headers, body bytes) for one events.list call."""
+    if ARGS.expired_token and authorization == "Bearer " + ARGS.expired_token:
+        count("unauthorized")
+        return 401, {}, b'{"error":{"code":401,"message":"Invalid Credentials"}}'
+
+    params = parse_qs(query)
+    page_size = min(int(params.get("maxResults", ["250"])[0]), ARGS.page_size)
+    sync_token = params.get("syncToken", [None])[0]
+
+    if sync_token is not None:
+        if sync_token != sync_token_for(calendar_id):
+            return 410, {}, b'{"error":{"code":410,"message":"Sync token is no longer valid"}}'
+        # Nothing ever changes on this server
+        items, offset = [], 0
+    else:
+        items = make_events(calendar_id)
+        offset = int(params.get("pageToken", ["0"])[0])
+
+    page = items[offset:offset + page_size]
+    body = {"kind": "calendar#events", "items": page}
+    if offset + page_size < len(items):
+        body["nextPageToken"] = str(offset + page_size)
+    else:
+        body["nextSyncToken"] = sync_token_for(calendar_id)
+
+    data = json.dumps(body).encode()
+    etag = '"%s"' % hashlib.md5(data).hexdigest()[:16]
+    if headers.get("If-None-Match") == etag:
+        count("not_modified")
+        return 304, {"ETag": etag}, b""
+    return 200, {"ETag": etag, "Content-Type": "application/json; charset=UTF-8"}, data
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # Keep-alive, like Google
+
+    def log_message(self, fmt, *args):
+        if not ARGS.quiet:
+            BaseHTTPRequestHandler.log_message(self, fmt, *args)
+
+    def send(self, status, headers, body):
+        accepts_gzip = "gzip" in self.headers.get("Accept-Encoding", "") and \
+                       "gzip" in self.headers.get("User-Agent", "")
+        if body and accepts_gzip and not ARGS.no_gzip:
+            body = gzip.compress(body)
+            headers = dict(headers, **{"Content-Encoding": "gzip"})
+
+        self.send_response(status)
+        for key, value in headers.items():
+            self.send_header(key, value)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+        count("bytes_out", len(body))
+
+    def delay(self):
+        count("requests")
+        if ARGS.latency:
+            time.sleep(ARGS.latency / 1000.0)
+
+    def read_body(self):
+        return self.rfile.read(int(self.headers.get("Content-Length", "0")))
+
+    def do_POST(self):
+        self.delay()
+        path = urlsplit(self.path).path
+        body = self.read_body()
+
+        if path.endswith("/token"):
+            if ARGS.refresh_fails:
+                self.send(400, {"Content-Type": "application/json"}, b'{"error":"invalid_grant"}')
+                return
+            TOKEN_COUNTER[0] += 1
+            token = {"access_token": "mock-token-%d" % TOKEN_COUNTER[0], "expires_in": ARGS.expires_in,
+                     "scope": "https://www.googleapis.com/auth/calendar.readonly", "token_type": "Bearer"}
+            self.send(200, {"Content-Type": "application/json"}, json.dumps(token).encode())
+        elif path == "/batch/calendar/v3":
+            count("batches")
+            self.batch(body)
+        else:
+            self.send(404, {}, b"")
+
+    def do_GET(self):
+        self.delay()
+        url = urlsplit(self.path)
+        parts = url.path.split("/")
+        # /calendar/v3/calendars/{id}/events
+        if len(parts) == 6 and parts[1:4] == ["calendar", "v3", "calendars"] and parts[5] == "events":
+            status, headers, data = events_response(unquote(parts[4]), url.query, self.headers,
+                                                    self.headers.get("Authorization"))
+            self.send(status, headers, data)
+        else:
+            self.send(404, {}, b"")
+
+    def batch(self, body):
+        content_type = self.headers.get("Content-Type", "")
+        boundary = content_type.split("boundary=")[-1].strip('"')
+        out_boundary = "batch_mock_%d" % random.randrange(1 << 30)
+        out = []
+
+        for raw in body.decode().split("--" + boundary):
+            raw = raw.strip("\r\n")
+            if not raw or raw == "--":
+                continue
+            mime, _, request = raw.partition("\r\n\r\n")
+            content_id = ""
+            for line in mime.split("\r\n"):
+                if line.lower().startswith("content-id:"):
+                    content_id = line.split(":", 1)[1].strip().strip("<>")
+            lines = request.split("\r\n")
+            method, target = lines[0].split(" ")[:2]
+            headers = dict(line.split(": ", 1) for line in lines[1:] if ": " in line)
+
+            url = urlsplit(target)
+            segments = url.path.split("/")
+            status, resp_headers, data = events_response(unquote(segments[4]), url.query, headers,
+                                                         headers.get("Authorization", self.headers.get("Authorization")))
+            part = "Content-Type: application/http\r\nContent-ID: <response-%s>\r\n\r\n" % content_id
+            part += "HTTP/1.1 %d %s\r\n" % (status, self.responses.get(status, ("",))[0])
+            for key, value in resp_headers.items():
+                part += "%s: %s\r\n" % (key, value)
+            part += "\r\n" + data.decode() + "\r\n"
+            out.append(part)
+
+        payload = "".join("--%s\r\n%s" % (out_boundary, part) for part in out) + "--%s--" % out_boundary
+        self.send(200, {"Content-Type": "multipart/mixed; boundary=" + out_boundary}, payload.encode())
+
+
+def main():
+    global ARGS
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--events", type=int, default=40, help="events per calendar this month")
+    parser.add_argument("--page-size", type=int, default=250, help="upper bound on maxResults")
+    parser.add_argument("--description-bytes", type=int, default=200, help="longest event description")
+    parser.add_argument("--latency", type=int, default=0, help="milliseconds added to every request")
+    parser.add_argument("--expires-in", type=int, default=3599, help="access token lifetime in seconds")
+    parser.add_argument("--expired-token", help="access token answered with 401")
+    parser.add_argument("--refresh-fails", action="store_true", help="reject every token refresh")
+    parser.add_argument("--no-gzip", action="store_true", help="never compress responses")
+    parser.add_argument("--certfile", help="serve HTTPS with this certificate")
+    parser.add_argument("--keyfile")
+    parser.add_argument("--quiet", action="store_true")
+    ARGS = parser.parse_args()
+
+    server = ThreadingHTTPServer(("0.0.0.0", ARGS.port), Handler)
+    if ARGS.certfile:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(ARGS.certfile, ARGS.keyfile)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+
+    # Stopped with kill from the host harness, the totals are printed either way
+    def stop(signum, frame):
+        raise KeyboardInterrupt
+    signal.signal(signal.SIGTERM, stop)
+
+    print("Mock Google Calendar on %s://0.0.0.0:%d" % ("https" if ARGS.certfile else "http", ARGS.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print("Served %(requests)d requests (%(batches)d batches), %(bytes_out)d bytes, "
+          "%(not_modified)d not modified, %(unauthorized)d unauthorized" % STATS)
+
+
+if __name__ == "__main__":
+    main()